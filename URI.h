@@ -24,6 +24,7 @@
 
 # include <inttypes.h>
 # include <sys/types.h>
+# include <sys/uio.h>
 # include <wchar.h>
 
 # ifndef URI_TYPE_DEFINED
@@ -32,6 +33,33 @@ typedef struct uri_struct URI;
 # endif
 
 typedef struct uri_info_struct URI_INFO;
+typedef struct uri_range_struct URI_RANGE;
+typedef struct uri_view_struct URI_VIEW;
+typedef struct uri_batch_struct URI_BATCH;
+typedef struct uri_resolver_struct URI_RESOLVER;
+typedef struct uri_parser_struct URI_PARSER;
+typedef struct uri_context_struct URI_CONTEXT;
+typedef struct uri_allocator_struct URI_ALLOCATOR;
+typedef struct uri_data_struct URI_DATA;
+typedef struct uri_data_reader_struct URI_DATA_READER;
+typedef struct uri_sink_struct URI_SINK;
+
+/* Flags which may be passed to uri_create_ascii_ex() */
+# define URI_PARSE_LAZY                (1<<0)
+# define URI_PARSE_NORMALISE_EAGER     0
+# define URI_PARSE_NORMALISE_NONE      (1<<1)
+# define URI_PARSE_NORMALISE_LAZY      (2<<1)
+# define URI_PARSE_NORMALISE_MASK      (3<<1)
+
+/* A URI parsed with URI_PARSE_LAZY completes its parsing in place when its
+ * components are first accessed, and one parsed (or duplicated from one
+ * parsed) with URI_PARSE_NORMALISE_LAZY normalises itself in place when it
+ * is first recomposed or compared, even via a const pointer. Such a URI
+ * must be fully accessed, for example by calling uri_str(), before it is
+ * used from more than one thread at once, including by duplicating it.
+ * uri_batch_create_parallel(), uri_batch_create_lines() and
+ * uri_str_batch_parallel() do this themselves for the URIs passed to them.
+ */
 
 /* Note that excepting the 'internal' member, URI_INFO can be safely
  * modified by the calling application if it's convenient to do so.
@@ -54,6 +82,85 @@ struct uri_info_struct
 #endif
 };
 
+/* A (pointer, length) range within a string; first is NULL if the range
+ * is absent. The range is not null-terminated.
+ */
+struct uri_range_struct
+{
+	const char *first;
+	size_t len;
+};
+
+/* A read-only view of a URI reference: each member is a range within the
+ * string which was passed to uri_view_parse(), which must remain valid for
+ * as long as the view is in use. A URI_VIEW does not own any resources, and
+ * so may be placed on the stack and discarded without being destroyed.
+ */
+struct uri_view_struct
+{
+	URI_RANGE scheme;
+	URI_RANGE auth;
+	URI_RANGE host;
+	URI_RANGE port;
+	URI_RANGE path;
+	URI_RANGE query;
+	URI_RANGE fragment;
+};
+
+/* The components of a data: URI: each member is a range within the string
+ * passed to uri_data_parse(), or the URI passed to uri_data(). Nothing is
+ * decoded; a URI_DATA does not own any resources.
+ */
+struct uri_data_struct
+{
+	/* The media type, e.g., 'text/plain'; absent if omitted, in which case
+	 * 'text/plain;charset=US-ASCII' is implied
+	 */
+	URI_RANGE mediatype;
+	/* The semicolon-separated parameters following the media type,
+	 * excluding ';base64'; absent if there are none
+	 */
+	URI_RANGE params;
+	/* The encoded payload following the comma */
+	URI_RANGE payload;
+	/* Is the payload base64-encoded? */
+	int base64;
+};
+
+/* The state of a data: URI payload decoder; the members are private */
+struct uri_data_reader_struct
+{
+	const char *p;
+	const char *end;
+	int base64;
+	unsigned long value;
+	int nsextets;
+	int padded;
+	unsigned char pending[3];
+	int npending;
+	int err;
+};
+
+/* A memory allocator: each of the functions is passed the data pointer
+ * as its first argument
+ */
+struct uri_allocator_struct
+{
+	void *(*alloc)(void *data, size_t size);
+	void *(*resize)(void *data, void *ptr, size_t size);
+	void (*release)(void *data, void *ptr);
+	void *data;
+};
+
+/* A destination to which uri_write() streams a URI: write() is called with
+ * each piece in turn, and returns 0 on success or -1 on failure
+ */
+struct uri_sink_struct
+{
+	int (*write)(void *data, const char *buf, size_t len);
+	void *data;
+};
+
 # if (!defined(__STDC_VERSION__) || __STDC_VERSION__ < 199901L) && !defined(restrict)
 #  define restrict
 # endif
@@ -84,7 +191,31 @@ URI *uri_create_wstr(const wchar_t *restrict uristr, const URI *restrict uri);
 /* Create a URI from a string and optional base URI */
 URI *uri_create_str(const char *restrict uristr, const URI *restrict uri);
 
-/* Create a URI from an existing URI and optional base URI */
+/* As the above, but taking the length of the source string (in characters)
+ * rather than requiring it to be null-terminated
+ */
+URI *uri_create_ascii_n(const char *restrict uristr, size_t len, const URI *restrict uri);
+URI *uri_create_ustr_n(const unsigned char *restrict uristr, size_t len, const URI *restrict uri);
+URI *uri_create_wstr_n(const wchar_t *restrict uristr, size_t len, const URI *restrict uri);
+URI *uri_create_str_n(const char *restrict uristr, size_t len, const URI *restrict uri);
+
+/* As uri_create_ascii_n(), with flags (URI_PARSE_xxx) which modify the
+ * behaviour of the parser
+ */
+URI *uri_create_ascii_ex(const char *restrict uristr, size_t len, const URI *restrict uri, unsigned int flags);
+
+/* Parse a 7-bit ASCII string into an existing URI, replacing its contents
+ * and reusing the memory which it already holds where possible; str must
+ * not point within the URI itself
+ */
+int uri_parse_into(URI *restrict uri, const char *restrict str, const URI *restrict base);
+int uri_parse_into_n(URI *restrict uri, const char *restrict str, size_t len, const URI *restrict base);
+
+/* Create a URI from an existing URI and optional base URI; the new URI
+ * has all of its components materialised, and so may be read from several
+ * threads at once unless its normalisation is still deferred (see
+ * URI_PARSE_LAZY above)
+ */
 URI *uri_create_uri(const URI *restrict source, const URI *restrict base);
 
 /* Create a file: URI from the current working directory */
@@ -104,9 +235,17 @@ int uri_absolute(const URI *uri);
  */
 int uri_absolute_path(const URI *uri);
 	
+/* Each component can be obtained in several ways: uri_xxx() copies it into
+ * the buffer provided and returns the buffer size needed to hold all of it;
+ * uri_xxx_str() returns a pointer to it; uri_xxx_view() returns a pointer
+ * to it and stores its length (which is retained, rather than recalculated)
+ * in *len; and uri_xxx_stralloc() returns a newly-allocated copy of it.
+ */
+
 /* Get or set the URI's scheme */
 size_t uri_scheme(const URI *restrict uri, char *restrict buf, size_t buflen);
 const char *uri_scheme_str(const URI *uri);
+const char *uri_scheme_view(const URI *restrict uri, size_t *restrict len);
 char *uri_scheme_stralloc(const URI *uri);
 int uri_set_scheme(URI *restrict uri, const char *restrict newscheme);
 
@@ -115,18 +254,21 @@ int uri_set_scheme(URI *restrict uri, const char *restrict newscheme);
  */
 size_t uri_auth(const URI *restrict uri, char *restrict buf, size_t buflen);
 const char *uri_auth_str(const URI *uri);
+const char *uri_auth_view(const URI *restrict uri, size_t *restrict len);
 char *uri_auth_stralloc(const URI *uri);
 int uri_set_auth(URI *restrict uri, const char *restrict newauth);
 
 /* Get or set the URI's hostname */
 size_t uri_host(const URI *restrict uri, char *restrict buf, size_t buflen);
 const char *uri_host_str(const URI *uri);
+const char *uri_host_view(const URI *restrict uri, size_t *restrict len);
 char *uri_host_stralloc(const URI *uri);
 int uri_set_host(URI *restrict uri, const char *restrict newhost);
 
 /* Copy the URI's port into the buffer provided */
 size_t uri_port(const URI *restrict uri, char *restrict buf, size_t buflen);
 const char *uri_port_str(const URI *uri);
+const char *uri_port_view(const URI *restrict uri, size_t *restrict len);
 char *uri_port_stralloc(const URI *uri);
 int uri_portnum(const URI *uri);
 int uri_set_port(URI *restrict uri, int newport);
@@ -134,24 +276,79 @@ int uri_set_port(URI *restrict uri, int newport);
 /* Copy the URI's path into the buffer provided */
 size_t uri_path(const URI *restrict uri, char *restrict buf, size_t buflen);
 
+/* Obtain the individual segments of the URI's path by index */
+size_t uri_path_segments_count(const URI *uri);
+size_t uri_path_segment(const URI *restrict uri, size_t index, char *restrict buf, size_t buflen);
+const char *uri_path_segment_str(const URI *uri, size_t index);
+const char *uri_path_segment_view(const URI *restrict uri, size_t index, size_t *restrict len);
+
+/* Walk the segments of the URI's path using a cursor: uri_peek() returns
+ * the segment at the cursor, uri_consume() returns it and advances the
+ * cursor, and uri_rewind() moves the cursor back to the first segment
+ */
+const char *uri_peek(const URI *uri);
+const char *uri_consume(URI *uri);
+int uri_rewind(URI *uri);
+
+/* Copy the namespace-specific string of a non-hierarchical URI (e.g.,
+ * 'isbn:0451450523' in 'urn:isbn:0451450523') into the buffer provided
+ */
+size_t uri_nss(const URI *restrict uri, char *restrict buf, size_t buflen);
+const char *uri_nss_str(const URI *uri);
+const char *uri_nss_view(const URI *restrict uri, size_t *restrict len);
+char *uri_nss_stralloc(const URI *uri);
+
 /* Copy the URI's query string into the buffer provided */
 size_t uri_query(const URI *restrict uri, char *restrict buf, size_t buflen);
 const char *uri_query_str(const URI *uri);
+const char *uri_query_view(const URI *restrict uri, size_t *restrict len);
 char *uri_query_stralloc(const URI *uri);
 int uri_set_query(URI *restrict uri, const char *newquery);
 
 /* Copy the URI's fragment into the buffer provided */
 size_t uri_fragment(const URI *restrict uri, char *restrict buf, size_t buflen);
 const char *uri_fragment_str(const URI *uri);
+const char *uri_fragment_view(const URI *restrict uri, size_t *restrict len);
 char *uri_fragment_stralloc(const URI *uri);
 int uri_set_fragment(URI *restrict uri, const char *newquery);
 
 /* Copy the whole URI, as a string, into the buffer provided */
 size_t uri_str(const URI *restrict uri, char *restrict buf, size_t buflen);
 
+/* Create the shortest reference which resolves to uri against base (the
+ * inverse of uri_rebase()), either as a new URI or recomposed into the
+ * buffer provided
+ */
+URI *uri_relativize(const URI *restrict uri, const URI *restrict base);
+size_t uri_relativize_str(const URI *restrict uri, const URI *restrict base, char *restrict buf, size_t buflen);
+
 /* Allocate a new string using malloc() and copy the URI into it */
 char *uri_stralloc(const URI *restrict uri);
 
+/* Describe the URI, as a string, as an array of iovec structures pointing
+ * at its components and the delimiters between them, without copying
+ * anything; the number of entries needed is returned, of which at most
+ * iovcnt are filled in. The entries must not be modified, and remain valid
+ * until the URI is modified or destroyed.
+ */
+size_t uri_iov(const URI *restrict uri, struct iovec *restrict iov, size_t iovcnt);
+
+/* Recompose an array of URIs into a single buffer (which must be freed
+ * with free()), each followed by separator; offsets, if non-NULL, has
+ * room for count + 1 entries and receives the offset of each URI followed
+ * by the total length, which is also stored in *len if it is non-NULL
+ */
+char *uri_str_batch(const URI *const *restrict uris, size_t count, int separator, size_t *restrict offsets, size_t *restrict len);
+
+/* As uri_str_batch(), dividing large arrays between up to nthreads threads
+ * (or one per online CPU if nthreads is zero)
+ */
+char *uri_str_batch_parallel(const URI *const *restrict uris, size_t count, int separator, size_t *restrict offsets, size_t *restrict len, unsigned nthreads);
+
+/* Stream the URI, as a string, to a sink or a file descriptor */
+int uri_write(const URI *restrict uri, const URI_SINK *restrict sink);
+int uri_write_fd(const URI *uri, int fd);
+
 /* Copy the various parts of the URI to a URI_INFO structure */
 URI_INFO *uri_info(const URI *uri);
 	
@@ -164,6 +361,149 @@ intmax_t uri_info_get_int(URI_INFO *info, const char *key, intmax_t defval);
 
 /* Compare two URIs and test for equality */
 int uri_equal(const URI *a, const URI *b);
+
+/* Normalise the syntax of a URI parsed with URI_PARSE_NORMALISE_NONE or
+ * URI_PARSE_NORMALISE_LAZY, and determine whether a URI is in normal form
+ */
+int uri_normalise(URI *uri);
+int uri_normalised(const URI *uri);
+
+/* Parse an array of UTF-8 strings against an optional base URI, allocating
+ * all of the resulting URIs from a single arena
+ */
+URI_BATCH *uri_batch_create(const unsigned char *const *restrict strs, size_t count, const URI *restrict base);
+
+/* As uri_batch_create(), but distributing the work across nthreads threads
+ * (or one per online CPU if nthreads is zero)
+ */
+URI_BATCH *uri_batch_create_parallel(const unsigned char *const *restrict strs, size_t count, const URI *restrict base, unsigned nthreads);
+
+/* As uri_batch_create_parallel(), but parsing each line of a buffer of
+ * newline-separated UTF-8 strings
+ */
+URI_BATCH *uri_batch_create_lines(const unsigned char *restrict buf, size_t len, const URI *restrict base, unsigned nthreads);
+
+/* Return the number of entries in a batch */
+size_t uri_batch_count(const URI_BATCH *batch);
+
+/* Obtain an entry from a batch (NULL if that string failed to parse); the
+ * URI belongs to the batch, and will be released along with it
+ */
+URI *uri_batch_uri(const URI_BATCH *batch, size_t index);
+
+/* Destroy a batch and all of the URIs within it */
+int uri_batch_destroy(URI_BATCH *batch);
+
+/* Create a resolver which resolves references against a fixed absolute
+ * base URI, which may be modified or destroyed afterwards
+ */
+URI_RESOLVER *uri_resolver_create(const URI *base);
+
+/* Resolve a 7-bit ASCII reference against a resolver's base, in the same
+ * way as uri_create_ascii()
+ */
+URI *uri_resolver_resolve(const URI_RESOLVER *restrict resolver, const char *restrict str);
+URI *uri_resolver_resolve_n(const URI_RESOLVER *restrict resolver, const char *restrict str, size_t len);
+
+/* Resolve an array of UTF-8 references against a resolver's base in the
+ * same way as uri_batch_create()
+ */
+URI_BATCH *uri_resolver_batch(const URI_RESOLVER *restrict resolver, const unsigned char *const *restrict strs, size_t count);
+
+/* Create references relative to a resolver's base for each of an array of
+ * URIs, as uri_relativize()
+ */
+URI_BATCH *uri_resolver_relativize(const URI_RESOLVER *restrict resolver, const URI *const *restrict uris, size_t count);
+
+/* Destroy a resolver; URIs obtained from it are unaffected */
+int uri_resolver_destroy(URI_RESOLVER *resolver);
+
+/* Set the allocator used by the library, or restore the default if
+ * allocator is NULL; this must be done before any objects are created
+ */
+int uri_set_allocator(const URI_ALLOCATOR *allocator);
+
+/* Create an allocation context, whose memory is obtained from allocator
+ * (or the global allocator, if it is NULL)
+ */
+URI_CONTEXT *uri_context_create(const URI_ALLOCATOR *allocator);
+
+/* Destroy a context, releasing every URI which was allocated from it */
+int uri_context_destroy(URI_CONTEXT *ctx);
+
+/* Enter a context on the calling thread, so that URIs subsequently created
+ * by the thread are allocated from it
+ */
+int uri_context_enter(URI_CONTEXT *ctx);
+
+/* Leave the context most recently entered on the calling thread */
+int uri_context_leave(URI_CONTEXT *ctx);
+
+/* Create an incremental parser, which accepts a URI reference in chunks as
+ * they become available; if maxlen is nonzero, longer input is rejected
+ */
+URI_PARSER *uri_parser_create(size_t maxlen);
+
+/* Destroy an incremental parser */
+int uri_parser_destroy(URI_PARSER *parser);
+
+/* Feed a chunk of input to an incremental parser; fails as soon as the
+ * input cannot be the start of a valid URI reference
+ */
+int uri_parser_feed(URI_PARSER *restrict parser, const char *restrict buf, size_t len);
+
+/* Complete parsing, returning a new URI (rebased against base, if it is
+ * non-NULL) and resetting the parser so that it can be reused
+ */
+URI *uri_parser_finish(URI_PARSER *restrict parser, const URI *restrict base);
+
+/* Discard any input fed to an incremental parser */
+int uri_parser_reset(URI_PARSER *parser);
+
+/* Parse len bytes of str into a read-only view without copying it */
+int uri_view_parse(URI_VIEW *restrict view, const char *restrict str, size_t len);
+
+/* Obtain the components of a view as (pointer, length) ranges within the
+ * original string; NULL is returned (and *len set to zero) if the component
+ * is absent. len may be NULL.
+ */
+const char *uri_view_scheme(const URI_VIEW *restrict view, size_t *restrict len);
+const char *uri_view_auth(const URI_VIEW *restrict view, size_t *restrict len);
+const char *uri_view_host(const URI_VIEW *restrict view, size_t *restrict len);
+const char *uri_view_port(const URI_VIEW *restrict view, size_t *restrict len);
+const char *uri_view_path(const URI_VIEW *restrict view, size_t *restrict len);
+const char *uri_view_query(const URI_VIEW *restrict view, size_t *restrict len);
+const char *uri_view_fragment(const URI_VIEW *restrict view, size_t *restrict len);
+
+/* Return 1 if the view has a scheme (and so is absolute), 0 otherwise */
+int uri_view_absolute(const URI_VIEW *view);
+
+/* Return the view's port as a parsed integer, or 0 if absent or invalid */
+int uri_view_portnum(const URI_VIEW *view);
+
+/* Locate the components of a data: URI held in len bytes of str, or in an
+ * existing URI object, without copying or decoding them
+ */
+int uri_data_parse(URI_DATA *restrict data, const char *restrict str, size_t len);
+int uri_data(const URI *restrict uri, URI_DATA *restrict data);
+
+/* Find a media type parameter of a data: URI by name, returning a range
+ * within the URI, or NULL if it is absent
+ */
+const char *uri_data_param(const URI_DATA *restrict data, const char *restrict name, size_t *restrict len);
+
+/* Decode the payload of a data: URI incrementally: uri_data_read() returns
+ * the number of octets stored in buf, or zero once the payload is complete
+ */
+int uri_data_open(URI_DATA_READER *restrict reader, const URI_DATA *restrict data);
+ssize_t uri_data_read(URI_DATA_READER *restrict reader, void *restrict buf, size_t buflen);
+
+/* Decode the payload of a data: URI in fixed-size chunks, passing each to a
+ * callback (which returns nonzero to stop) or writing it to a file
+ * descriptor
+ */
+int uri_data_each(const URI_DATA *restrict data, int (*callback)(void *ctx, const void *buf, size_t len), void *ctx);
+int uri_data_write(const URI_DATA *data, int fd);
 	
 END_DECLS_
 
@@ -0,0 +1,290 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* Memory used internally by the library is obtained through the allocator
+ * registered with uri_set_allocator(), which defaults to the C library's.
+ *
+ * A context is a region from which URIs, and everything they subsequently
+ * allocate, can be obtained: while a context is entered on a thread, any
+ * URI created on that thread is allocated from the context, and remains
+ * valid until the context is destroyed. Such URIs do not need to be
+ * destroyed individually (although uri_destroy() may safely be called).
+ */
+
+static URI_ALLOCATOR uri_allocator_;
+
+/* The innermost context entered on the current thread */
+static __thread URI_CONTEXT *uri_context_current_;
+
+/* Set the allocator used for all subsequent allocations, or if allocator is
+ * NULL, restore the default. This must be called before any URIs or other
+ * objects are created, as they will be freed using whichever allocator is
+ * current at the time.
+ */
+int
+uri_set_allocator(const URI_ALLOCATOR *allocator)
+{
+	if(!allocator)
+	{
+		memset(&uri_allocator_, 0, sizeof(URI_ALLOCATOR));
+		return 0;
+	}
+	if(!allocator->alloc || !allocator->resize || !allocator->release)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	uri_allocator_ = *allocator;
+	return 0;
+}
+
+/* Create a new allocation context. The memory for the context is obtained
+ * from allocator, if it is non-NULL, or the global allocator otherwise.
+ */
+URI_CONTEXT *
+uri_context_create(const URI_ALLOCATOR *allocator)
+{
+	URI_CONTEXT *ctx;
+
+	if(allocator && (!allocator->alloc || !allocator->resize || !allocator->release))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	ctx = (URI_CONTEXT *) uri_mem_calloc_(1, sizeof(URI_CONTEXT));
+	if(!ctx)
+	{
+		return NULL;
+	}
+	if(allocator)
+	{
+		ctx->allocator = *allocator;
+		ctx->arena.allocator = &(ctx->allocator);
+	}
+	return ctx;
+}
+
+/* Destroy a context, releasing all of the URIs allocated from it */
+int
+uri_context_destroy(URI_CONTEXT *ctx)
+{
+	if(!ctx)
+	{
+		return 0;
+	}
+	if(ctx->entered)
+	{
+		errno = EBUSY;
+		return -1;
+	}
+	uri_arena_destroy_(&(ctx->arena));
+	uri_mem_free_(ctx);
+	return 0;
+}
+
+/* Enter a context on the calling thread: until it is left, URIs created by
+ * this thread are allocated from it. Contexts may be nested, but a context
+ * can only be entered by one thread at a time.
+ */
+int
+uri_context_enter(URI_CONTEXT *ctx)
+{
+	if(ctx->entered)
+	{
+		errno = EBUSY;
+		return -1;
+	}
+	ctx->prev = uri_context_current_;
+	ctx->entered = 1;
+	uri_context_current_ = ctx;
+	return 0;
+}
+
+/* Leave a context, which must be the innermost context entered on the
+ * calling thread
+ */
+int
+uri_context_leave(URI_CONTEXT *ctx)
+{
+	if(uri_context_current_ != ctx)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	uri_context_current_ = ctx->prev;
+	ctx->prev = NULL;
+	ctx->entered = 0;
+	return 0;
+}
+
+/* Internal: return the arena of the context entered on the calling thread,
+ * if any
+ */
+struct uri_arena_struct *
+uri_context_arena_(void)
+{
+	return (uri_context_current_ ? &(uri_context_current_->arena) : NULL);
+}
+
+/* Internal: allocate memory using the global allocator */
+void *
+uri_mem_alloc_(size_t size)
+{
+	if(uri_allocator_.alloc)
+	{
+		return uri_allocator_.alloc(uri_allocator_.data, size);
+	}
+	return malloc(size);
+}
+
+/* Internal: allocate zero-filled memory using the global allocator */
+void *
+uri_mem_calloc_(size_t nmemb, size_t size)
+{
+	void *p;
+
+	if(!uri_allocator_.alloc)
+	{
+		return calloc(nmemb, size);
+	}
+	if(size && nmemb > (size_t) -1 / size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	p = uri_allocator_.alloc(uri_allocator_.data, nmemb * size);
+	if(p)
+	{
+		memset(p, 0, nmemb * size);
+	}
+	return p;
+}
+
+/* Internal: resize memory obtained from the global allocator */
+void *
+uri_mem_realloc_(void *ptr, size_t size)
+{
+	if(uri_allocator_.resize)
+	{
+		return uri_allocator_.resize(uri_allocator_.data, ptr, size);
+	}
+	return realloc(ptr, size);
+}
+
+/* Internal: release memory obtained from the global allocator */
+void
+uri_mem_free_(void *ptr)
+{
+	if(!ptr)
+	{
+		return;
+	}
+	if(uri_allocator_.release)
+	{
+		uri_allocator_.release(uri_allocator_.data, ptr);
+		return;
+	}
+	free(ptr);
+}
+
+/* Internal: duplicate a string using the global allocator */
+char *
+uri_mem_strdup_(const char *src)
+{
+	size_t l;
+	char *p;
+
+	l = strlen(src) + 1;
+	p = (char *) uri_mem_alloc_(l);
+	if(p)
+	{
+		memcpy(p, src, l);
+	}
+	return p;
+}
+
+/* Internal: duplicate a string which will be owned by uri; if the URI was
+ * allocated from an arena, so is the copy
+ */
+char *
+uri_strdup_(URI *uri, const char *src)
+{
+	size_t l;
+	char *p;
+
+	if(!uri->arena)
+	{
+		return uri_mem_strdup_(src);
+	}
+	l = strlen(src) + 1;
+	p = (char *) uri_arena_alloc_(uri->arena, l);
+	if(p)
+	{
+		memcpy(p, src, l);
+	}
+	return p;
+}
+
+/* Internal: duplicate the first len characters of a string (which need
+ * not be null-terminated) into memory which will be owned by uri
+ */
+char *
+uri_strndup_(URI *restrict uri, const char *restrict src, size_t len)
+{
+	char *p;
+
+	if(uri->arena)
+	{
+		p = (char *) uri_arena_alloc_(uri->arena, len + 1);
+	}
+	else
+	{
+		p = (char *) uri_mem_alloc_(len + 1);
+	}
+	if(p)
+	{
+		memcpy(p, src, len);
+		p[len] = 0;
+	}
+	return p;
+}
+
+/* Internal: duplicate a string which will be owned by uri, placing it in
+ * buf (one of the URI's inline buffers, of bufsize bytes) if it will fit;
+ * src may already be held in buf
+ */
+char *
+uri_strdup_inline_(URI *restrict uri, const char *src, char *buf, size_t bufsize)
+{
+	size_t l;
+
+	l = strlen(src) + 1;
+	if(l > bufsize)
+	{
+		return uri_strdup_(uri, src);
+	}
+	memmove(buf, src, l);
+	return buf;
+}
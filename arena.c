@@ -0,0 +1,115 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* A simple region allocator: memory is carved sequentially from a list of
+ * chunks, and is only ever released all at once by uri_arena_destroy_().
+ * Arenas are not thread-safe.
+ */
+
+/* The default size of each chunk, excluding its header */
+#define URI_ARENA_CHUNKSIZE_            (64 * 1024)
+
+/* All allocations are aligned to this boundary */
+#define URI_ARENA_ALIGN_                (2 * sizeof(void *))
+
+struct uri_arena_chunk_struct
+{
+	struct uri_arena_chunk_struct *next;
+	size_t size;
+	size_t used;
+};
+
+/* The chunk header is padded so that the data which follows it is aligned */
+#define URI_ARENA_HEADER_ \
+	((sizeof(struct uri_arena_chunk_struct) + URI_ARENA_ALIGN_ - 1) & ~(URI_ARENA_ALIGN_ - 1))
+
+/* Internal: allocate size bytes of zero-filled memory from an arena */
+void *
+uri_arena_alloc_(struct uri_arena_struct *arena, size_t size)
+{
+	struct uri_arena_chunk_struct *chunk;
+	size_t chunksize;
+	char *p;
+
+	size = (size + URI_ARENA_ALIGN_ - 1) & ~(URI_ARENA_ALIGN_ - 1);
+	chunk = arena->chunks;
+	if(!chunk || chunk->size - chunk->used < size)
+	{
+		chunksize = (size > URI_ARENA_CHUNKSIZE_ ? size : URI_ARENA_CHUNKSIZE_);
+		if(arena->allocator)
+		{
+			chunk = (struct uri_arena_chunk_struct *) arena->allocator->alloc(arena->allocator->data, URI_ARENA_HEADER_ + chunksize);
+		}
+		else
+		{
+			chunk = (struct uri_arena_chunk_struct *) uri_mem_alloc_(URI_ARENA_HEADER_ + chunksize);
+		}
+		if(!chunk)
+		{
+			return NULL;
+		}
+		chunk->size = chunksize;
+		chunk->used = 0;
+		if(arena->chunks && size > URI_ARENA_CHUNKSIZE_)
+		{
+			/* Oversized allocations get a chunk of their own, which is
+			 * placed behind the current chunk so that the space remaining
+			 * in that chunk is not wasted
+			 */
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		}
+		else
+		{
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+	p = (char *) chunk + URI_ARENA_HEADER_ + chunk->used;
+	chunk->used += size;
+	memset(p, 0, size);
+	return p;
+}
+
+/* Internal: release all of the memory allocated from an arena */
+void
+uri_arena_destroy_(struct uri_arena_struct *arena)
+{
+	struct uri_arena_chunk_struct *chunk, *next;
+
+	for(chunk = arena->chunks; chunk; chunk = next)
+	{
+		next = chunk->next;
+		if(arena->allocator)
+		{
+			arena->allocator->release(arena->allocator->data, chunk);
+		}
+		else
+		{
+			uri_mem_free_(chunk);
+		}
+	}
+	arena->chunks = NULL;
+}
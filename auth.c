@@ -30,26 +30,24 @@
 size_t
 uri_auth(const URI *restrict uri, char *restrict buf, size_t buflen)
 {
-	if(!uri->auth)
-	{
-		if(buf && buflen)
-		{
-			*buf = 0;
-		}
-		return 0;
-	}
-	if(buf && buflen)
-	{
-		strncpy(buf, uri->auth, buflen - 1);
-		buf[buflen - 1] = 0;
-	}
-	return strlen(uri->auth) + 1;
+	uri_lazy_(uri, URI_LAZY_AUTH_);
+	return uri_copy_(uri->auth, uri->authlen, buf, buflen);
 }
 
 /* Return the auth as const string pointer */
 const char *
 uri_auth_str(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_AUTH_);
+	return uri->auth;
+}
+
+/* Return the auth as a pointer and length, without rescanning it */
+const char *
+uri_auth_view(const URI *restrict uri, size_t *restrict len)
+{
+	uri_lazy_(uri, URI_LAZY_AUTH_);
+	*len = uri->authlen;
 	return uri->auth;
 }
 
@@ -59,6 +57,7 @@ uri_auth_str(const URI *uri)
 char *
 uri_auth_stralloc(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_AUTH_);
 	if(!uri->auth)
 	{
 		errno = 0;
@@ -73,32 +72,26 @@ uri_set_auth(URI *restrict uri, const char *restrict newauth)
 {
 	char *sbuf;
 
+	uri_lazy_(uri, URI_LAZY_AUTH_);
 	sbuf = NULL;
 	if(newauth)
 	{
-		sbuf = strdup(newauth);
+		sbuf = uri_strdup_(uri, newauth);
 		if(!sbuf)
 		{
 			return -1;
 		}
 		newauth = sbuf;
 	}
-	free(uri->auth);
+	uri_recomposed_dirty_(uri, URI_COMPOSED_AUTHORITY_);
+	uri_free_(uri, uri->auth);
 	uri->auth = sbuf;
-	uri->uri.userInfo.first = sbuf;
-	if(sbuf)
-	{
-		uri->uri.userInfo.afterLast = strchr(sbuf, 0);
-	}
-	else
-	{
-		uri->uri.userInfo.afterLast = NULL;
-	}
+	uri->authlen = (sbuf ? strlen(sbuf) : 0);
 	/* Reset the user and password components so that they will be
 	 * re-parsed
 	 */
-	free(uri->user);
-	free(uri->password);
+	uri_free_(uri, uri->user);
+	uri_free_(uri, uri->password);
 	uri->user = NULL;
 	uri->password = NULL;
 	return 0;
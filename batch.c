@@ -0,0 +1,122 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* Parse an array of UTF-8 strings, each of which is treated in the same
+ * way as by uri_create_ustr() (including rebasing against base, if it is
+ * non-NULL). All of the resulting URIs are allocated from a single arena
+ * which is released by uri_batch_destroy(). If an individual string
+ * cannot be parsed, the corresponding entry in the batch is NULL.
+ */
+URI_BATCH *
+uri_batch_create(const unsigned char *const *restrict strs, size_t count, const URI *restrict base)
+{
+	URI_BATCH *batch;
+	char *buf;
+	size_t c, buflen;
+
+	batch = (URI_BATCH *) uri_mem_calloc_(1, sizeof(URI_BATCH));
+	if(!batch)
+	{
+		return NULL;
+	}
+	batch->count = count;
+	if(count)
+	{
+		batch->uris = (URI **) uri_arena_alloc_(&(batch->arena), count * sizeof(URI *));
+		if(!batch->uris)
+		{
+			uri_batch_destroy(batch);
+			return NULL;
+		}
+	}
+	/* The buffer used to map each IRI to a URI is shared by all of them */
+	buf = NULL;
+	buflen = 0;
+	for(c = 0; c < count; c++)
+	{
+		if(uri_preprocess_ustr_(strs[c], strlen((const char *) strs[c]), &buf, &buflen))
+		{
+			if(errno == ENOMEM)
+			{
+				uri_mem_free_(buf);
+				uri_batch_destroy(batch);
+				return NULL;
+			}
+			continue;
+		}
+		batch->uris[c] = uri_parse_(buf, strlen(buf), base, &(batch->arena));
+	}
+	uri_mem_free_(buf);
+	return batch;
+}
+
+/* Return the number of entries in a batch */
+size_t
+uri_batch_count(const URI_BATCH *batch)
+{
+	return batch->count;
+}
+
+/* Return a URI from a batch; the URI remains owned by the batch */
+URI *
+uri_batch_uri(const URI_BATCH *batch, size_t index)
+{
+	if(index >= batch->count)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	return batch->uris[index];
+}
+
+/* Destroy a batch, along with all of the URIs within it */
+int
+uri_batch_destroy(URI_BATCH *batch)
+{
+	size_t c;
+
+	if(!batch)
+	{
+		return 0;
+	}
+	/* Release anything which the URIs hold outside of the arena (for
+	 * example, components which have been replaced by a setter)
+	 */
+	for(c = 0; batch->uris && c < batch->count; c++)
+	{
+		if(batch->uris[c])
+		{
+			uri_reset_(batch->uris[c]);
+		}
+	}
+	for(c = 0; c < batch->narenas; c++)
+	{
+		uri_arena_destroy_(&(batch->arenas[c]));
+	}
+	uri_mem_free_(batch->arenas);
+	uri_arena_destroy_(&(batch->arena));
+	uri_mem_free_(batch);
+	return 0;
+}
@@ -0,0 +1,566 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* data: URIs (RFC 2397) have the form:
+ *
+ * 'data:' [ mediatype ] *( ';' parameter ) [ ';base64' ] ',' payload
+ *
+ * uri_data_parse() and uri_data() locate the media type, parameters and
+ * payload without copying or decoding anything, so that a large payload
+ * can then be decoded incrementally by a URI_DATA_READER into a buffer of
+ * any size, or passed in fixed-size chunks to a file descriptor or a
+ * callback.
+ *
+ * Percent-encoded octets are decoded in all payloads, including base64
+ * ones. On x86 processors which support SSSE3, base64 payloads are decoded
+ * 16 characters at a time where they contain no percent-encoded octets or
+ * padding; everything else is handled by the scalar code.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define URI_DATA_X86_                  1
+# include <immintrin.h>
+#endif
+
+/* The size of the chunks passed to uri_data_write() and uri_data_each() */
+#define URI_DATA_CHUNK_                 16384
+
+static int uri_data_header_(URI_DATA *restrict data, const char *p, const char *end);
+static int uri_data_casecmp_(const char *p, size_t len, const char *lit);
+static int uri_data_hex_(const char *p);
+static ssize_t uri_data_fail_(URI_DATA_READER *reader);
+static int uri_data_emit_(URI_DATA_READER *restrict reader, unsigned char *restrict *restrict out, size_t *restrict room, unsigned long value, int count);
+
+#ifdef URI_DATA_X86_
+static size_t uri_data_ssse3_(const char *p, const char *end, unsigned char *out, size_t room) __attribute__((target("ssse3")));
+#endif
+
+/* The value of each base64 character, or -1 for non-base64 characters */
+static const signed char uri_data_b64_[128] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1
+};
+
+/* Locate the components of a data: URI within str[0..len-1], which need
+ * not be null-terminated; any fragment is excluded from the payload. The
+ * members of data are ranges within str, which must remain valid for as
+ * long as data (or any reader opened on it) is in use.
+ */
+int
+uri_data_parse(URI_DATA *restrict data, const char *restrict str, size_t len)
+{
+	struct uri_scan_struct scan;
+	const char *end;
+
+	memset(data, 0, sizeof(URI_DATA));
+	if(uri_scan_(str, len, &scan))
+	{
+		return -1;
+	}
+	if(!scan.scheme.first || !uri_data_casecmp_(scan.scheme.first, scan.scheme.afterLast - scan.scheme.first, "data"))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	end = (scan.fragment.first ? scan.fragment.first - 1 : str + len);
+	return uri_data_header_(data, scan.scheme.afterLast + 1, end);
+}
+
+/* Locate the components of a data: URI which has already been parsed; the
+ * members of data are ranges within the URI, and so are only valid until
+ * it is modified or destroyed
+ */
+int
+uri_data(const URI *restrict uri, URI_DATA *restrict data)
+{
+	const char *nss;
+	size_t len;
+
+	memset(data, 0, sizeof(URI_DATA));
+	nss = uri_nss_view(uri, &len);
+	if(uri->hier || !uri->scheme || !nss || !uri_data_casecmp_(uri->scheme, uri->schemelen, "data"))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	return uri_data_header_(data, nss, nss + len);
+}
+
+/* Find the value of the media type parameter named name (which is matched
+ * case-insensitively), returning a pointer to it and storing its length in
+ * *len (if len is non-NULL), or NULL if there is no such parameter. The
+ * value is not null-terminated, and is returned exactly as it appears in
+ * the URI.
+ */
+const char *
+uri_data_param(const URI_DATA *restrict data, const char *restrict name, size_t *restrict len)
+{
+	const char *p, *end, *t, *eq;
+	size_t namelen;
+
+	if(len)
+	{
+		*len = 0;
+	}
+	if(!data->params.first)
+	{
+		return NULL;
+	}
+	namelen = strlen(name);
+	end = data->params.first + data->params.len;
+	for(p = data->params.first; p < end; p = t + 1)
+	{
+		t = (const char *) memchr(p, ';', end - p);
+		if(!t)
+		{
+			t = end;
+		}
+		eq = (const char *) memchr(p, '=', t - p);
+		if(eq && (size_t) (eq - p) == namelen && uri_data_casecmp_(p, namelen, name))
+		{
+			if(len)
+			{
+				*len = t - (eq + 1);
+			}
+			return eq + 1;
+		}
+	}
+	return NULL;
+}
+
+/* Prepare to decode the payload of a data: URI */
+int
+uri_data_open(URI_DATA_READER *restrict reader, const URI_DATA *restrict data)
+{
+	memset(reader, 0, sizeof(URI_DATA_READER));
+	reader->p = data->payload.first;
+	reader->end = data->payload.first + data->payload.len;
+	reader->base64 = data->base64;
+	return 0;
+}
+
+/* Decode up to buflen octets of the payload into buf, returning the number
+ * of octets stored, which is zero once the whole payload has been decoded.
+ * If the payload is malformed, -1 is returned with errno set to EINVAL, and
+ * all further reads will also fail.
+ */
+ssize_t
+uri_data_read(URI_DATA_READER *restrict reader, void *restrict buf, size_t buflen)
+{
+	unsigned char *out;
+	const char *t;
+	size_t room, n;
+	int ch, v;
+
+	if(reader->err)
+	{
+		errno = reader->err;
+		return -1;
+	}
+	out = (unsigned char *) buf;
+	room = buflen;
+	/* Octets left over from a base64 quantum which didn't fit last time */
+	while(reader->npending && room)
+	{
+		*out = reader->pending[3 - reader->npending];
+		reader->npending--;
+		out++;
+		room--;
+	}
+	while(room && reader->p < reader->end)
+	{
+		if(*(reader->p) == '%')
+		{
+			if(reader->end - reader->p < 3 || (ch = uri_data_hex_(reader->p + 1)) < 0)
+			{
+				return uri_data_fail_(reader);
+			}
+			reader->p += 3;
+		}
+		else if(!reader->base64)
+		{
+			/* Copy everything up to the next percent-encoded octet */
+			n = reader->end - reader->p;
+			if(n > room)
+			{
+				n = room;
+			}
+			t = (const char *) memchr(reader->p, '%', n);
+			if(t)
+			{
+				n = t - reader->p;
+			}
+			memcpy(out, reader->p, n);
+			reader->p += n;
+			out += n;
+			room -= n;
+			continue;
+		}
+		else
+		{
+#ifdef URI_DATA_X86_
+			if(!reader->nsextets && !reader->padded && reader->end - reader->p >= 16 && room >= 16 &&
+			   __builtin_cpu_supports("ssse3"))
+			{
+				n = uri_data_ssse3_(reader->p, reader->end, out, room);
+				if(n)
+				{
+					reader->p += n;
+					out += (n / 4) * 3;
+					room -= (n / 4) * 3;
+					continue;
+				}
+			}
+#endif
+			ch = (unsigned char) *(reader->p);
+			reader->p++;
+		}
+		if(!reader->base64)
+		{
+			*out = (unsigned char) ch;
+			out++;
+			room--;
+			continue;
+		}
+		if(ch == '=')
+		{
+			/* Padding completes the final quantum */
+			if(reader->nsextets < 2 && !reader->padded)
+			{
+				return uri_data_fail_(reader);
+			}
+			if(!reader->padded && uri_data_emit_(reader, &out, &room, reader->value, reader->nsextets))
+			{
+				return uri_data_fail_(reader);
+			}
+			reader->padded = 1;
+			continue;
+		}
+		v = (ch < 128 ? uri_data_b64_[ch] : -1);
+		if(v < 0 || reader->padded)
+		{
+			return uri_data_fail_(reader);
+		}
+		reader->value = (reader->value << 6) | (unsigned long) v;
+		reader->nsextets++;
+		if(reader->nsextets == 4 && uri_data_emit_(reader, &out, &room, reader->value, 4))
+		{
+			return uri_data_fail_(reader);
+		}
+	}
+	/* An unpadded final quantum */
+	if(reader->p >= reader->end && reader->base64 && reader->nsextets && !reader->padded)
+	{
+		if(uri_data_emit_(reader, &out, &room, reader->value, reader->nsextets))
+		{
+			return uri_data_fail_(reader);
+		}
+		reader->padded = 1;
+		while(reader->npending && room)
+		{
+			*out = reader->pending[3 - reader->npending];
+			reader->npending--;
+			out++;
+			room--;
+		}
+	}
+	return (ssize_t) (out - (unsigned char *) buf);
+}
+
+/* Decode the payload of a data: URI, passing it to callback in chunks;
+ * if callback returns nonzero, decoding stops and -1 is returned
+ */
+int
+uri_data_each(const URI_DATA *restrict data, int (*callback)(void *ctx, const void *buf, size_t len), void *ctx)
+{
+	URI_DATA_READER reader;
+	unsigned char buf[URI_DATA_CHUNK_];
+	ssize_t r;
+
+	uri_data_open(&reader, data);
+	while((r = uri_data_read(&reader, buf, sizeof(buf))) > 0)
+	{
+		if(callback(ctx, buf, (size_t) r))
+		{
+			return -1;
+		}
+	}
+	return (r < 0 ? -1 : 0);
+}
+
+/* Decode the payload of a data: URI, writing it to the file descriptor fd */
+int
+uri_data_write(const URI_DATA *data, int fd)
+{
+	URI_DATA_READER reader;
+	unsigned char buf[URI_DATA_CHUNK_];
+	ssize_t r, w;
+	size_t c;
+
+	uri_data_open(&reader, data);
+	while((r = uri_data_read(&reader, buf, sizeof(buf))) > 0)
+	{
+		for(c = 0; c < (size_t) r; c += w)
+		{
+			w = write(fd, buf + c, r - c);
+			if(w < 0)
+			{
+				if(errno == EINTR)
+				{
+					w = 0;
+					continue;
+				}
+				return -1;
+			}
+		}
+	}
+	return (r < 0 ? -1 : 0);
+}
+
+/* Internal: locate the media type, parameters and payload of a data: URI,
+ * given the portion between the scheme and any fragment
+ */
+static int
+uri_data_header_(URI_DATA *restrict data, const char *p, const char *end)
+{
+	const char *comma, *t, *last;
+
+	comma = (const char *) memchr(p, ',', end - p);
+	if(!comma)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	data->payload.first = comma + 1;
+	data->payload.len = end - (comma + 1);
+	/* The media type extends to the first semicolon */
+	for(t = p; t < comma && *t != ';'; t++);
+	if(t > p)
+	{
+		data->mediatype.first = p;
+		data->mediatype.len = t - p;
+	}
+	if(t >= comma)
+	{
+		return 0;
+	}
+	t++;
+	/* A final ';base64' is not a parameter */
+	for(last = comma; last > t && last[-1] != ';'; last--);
+	if(uri_data_casecmp_(last, comma - last, "base64"))
+	{
+		data->base64 = 1;
+		comma = (last > t ? last - 1 : t);
+	}
+	if(comma > t)
+	{
+		data->params.first = t;
+		data->params.len = comma - t;
+	}
+	return 0;
+}
+
+/* Internal: return nonzero if p[0..len-1] matches the null-terminated
+ * string lit, ignoring case
+ */
+static int
+uri_data_casecmp_(const char *p, size_t len, const char *lit)
+{
+	size_t c;
+	int a, b;
+
+	for(c = 0; c < len; c++)
+	{
+		a = (unsigned char) p[c];
+		b = (unsigned char) lit[c];
+		if(a >= 'A' && a <= 'Z')
+		{
+			a += 'a' - 'A';
+		}
+		if(b >= 'A' && b <= 'Z')
+		{
+			b += 'a' - 'A';
+		}
+		if(!b || a != b)
+		{
+			return 0;
+		}
+	}
+	return !lit[c];
+}
+
+/* Internal: decode the two hexadecimal digits at p, returning -1 if either
+ * is invalid
+ */
+static int
+uri_data_hex_(const char *p)
+{
+	int c, n, v;
+
+	v = 0;
+	for(c = 0; c < 2; c++)
+	{
+		n = (unsigned char) p[c];
+		if(n >= '0' && n <= '9')
+		{
+			n -= '0';
+		}
+		else if(n >= 'a' && n <= 'f')
+		{
+			n -= 'a' - 10;
+		}
+		else if(n >= 'A' && n <= 'F')
+		{
+			n -= 'A' - 10;
+		}
+		else
+		{
+			return -1;
+		}
+		v = (v << 4) | n;
+	}
+	return v;
+}
+
+/* Internal: place a reader into the failed state, so that all subsequent
+ * reads fail
+ */
+static ssize_t
+uri_data_fail_(URI_DATA_READER *reader)
+{
+	reader->err = EINVAL;
+	errno = EINVAL;
+	return -1;
+}
+
+/* Internal: store the octets of a base64 quantum of count sextets (2, 3
+ * or 4) held in value, keeping any which don't fit in the remaining space
+ * for the next call to uri_data_read()
+ */
+static int
+uri_data_emit_(URI_DATA_READER *restrict reader, unsigned char *restrict *restrict out, size_t *restrict room, unsigned long value, int count)
+{
+	unsigned char octets[3];
+	int n, c;
+
+	if(count < 2)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	/* Left-align a partial quantum */
+	value <<= 6 * (4 - count);
+	octets[0] = (unsigned char) (value >> 16);
+	octets[1] = (unsigned char) (value >> 8);
+	octets[2] = (unsigned char) value;
+	n = count - 1;
+	for(c = 0; c < n && *room; c++)
+	{
+		**out = octets[c];
+		(*out)++;
+		(*room)--;
+	}
+	/* Pending octets are stored right-aligned */
+	reader->npending = n - c;
+	memcpy(reader->pending + (3 - reader->npending), octets + c, reader->npending);
+	reader->value = 0;
+	reader->nsextets = 0;
+	return 0;
+}
+
+#ifdef URI_DATA_X86_
+/* Internal: decode base64 16 characters at a time, for as long as there
+ * are at least 16 characters of input and 16 octets of space remaining
+ * (although only 12 are produced from each block), returning the number of
+ * characters consumed. Decoding stops at the first block which contains
+ * anything other than base64 characters, such as padding or a
+ * percent-encoded octet, which the scalar code must deal with.
+ *
+ * Each character is validated and translated to its sextet using the low
+ * and high nibbles to index lookup tables, in the same way as the
+ * structural scanner; the sextets are then packed together with multiply-
+ * add instructions and shuffled into place.
+ */
+static size_t
+uri_data_ssse3_(const char *p, const char *end, unsigned char *out, size_t room)
+{
+	/* For each low nibble, a bitmap of the high nibbles which form valid
+	 * base64 characters with it
+	 */
+	const __m128i masklut = _mm_setr_epi8(
+		(char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+		(char) 0xf8, (char) 0xf8, (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+	const __m128i bitlut = _mm_setr_epi8(
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	/* For each high nibble, the offset which translates a character to its
+	 * sextet ('/' is a special case)
+	 */
+	const __m128i shiftlut = _mm_setr_epi8(
+		0, 0, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i pack = _mm_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	const __m128i slash = _mm_set1_epi8('/');
+	__m128i v, hi, lo, shift;
+	const char *start;
+
+	start = p;
+	while(end - p >= 16 && room >= 16)
+	{
+		v = _mm_loadu_si128((const __m128i *) p);
+		hi = _mm_and_si128(_mm_srli_epi32(v, 4), nibble);
+		lo = _mm_and_si128(v, nibble);
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(_mm_shuffle_epi8(masklut, lo), _mm_shuffle_epi8(bitlut, hi)), _mm_setzero_si128())))
+		{
+			break;
+		}
+		/* '/' shares its high nibble with '+', but is offset by 16 rather
+		 * than 19
+		 */
+		shift = _mm_add_epi8(_mm_shuffle_epi8(shiftlut, hi), _mm_and_si128(_mm_cmpeq_epi8(v, slash), _mm_set1_epi8(-3)));
+		v = _mm_add_epi8(v, shift);
+		/* Combine pairs of sextets into 12-bit values, then pairs of those
+		 * into 24-bit values, and gather the three octets of each
+		 */
+		v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+		v = _mm_shuffle_epi8(v, pack);
+		_mm_storeu_si128((__m128i *) out, v);
+		p += 16;
+		out += 12;
+		room -= 12;
+	}
+	return p - start;
+}
+#endif /*URI_DATA_X86_*/
@@ -30,26 +30,24 @@
 size_t
 uri_fragment(const URI *restrict uri, char *restrict buf, size_t buflen)
 {
-	if(!uri->fragment)
-	{
-		if(buf && buflen)
-		{
-			*buf = 0;
-		}
-		return 0;
-	}
-	if(buf && buflen)
-	{
-		strncpy(buf, uri->fragment, buflen - 1);
-		buf[buflen - 1] = 0;
-	}
-	return strlen(uri->fragment) + 1;
+	uri_lazy_(uri, URI_LAZY_FRAGMENT_);
+	return uri_copy_(uri->fragment, uri->fragmentlen, buf, buflen);
 }
 
 /* Return the fragment as const string pointer */
 const char *
 uri_fragment_str(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_FRAGMENT_);
+	return uri->fragment;
+}
+
+/* Return the fragment as a pointer and length, without rescanning it */
+const char *
+uri_fragment_view(const URI *restrict uri, size_t *restrict len)
+{
+	uri_lazy_(uri, URI_LAZY_FRAGMENT_);
+	*len = uri->fragmentlen;
 	return uri->fragment;
 }
 
@@ -59,6 +57,7 @@ uri_fragment_str(const URI *uri)
 char *
 uri_fragment_stralloc(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_FRAGMENT_);
 	if(!uri->fragment)
 	{
 		errno = 0;
@@ -73,26 +72,20 @@ uri_set_fragment(URI *restrict uri, const char *restrict newfragment)
 {
 	char *sbuf;
 	
+	uri_lazy_(uri, URI_LAZY_FRAGMENT_);
 	sbuf = NULL;
 	if(newfragment)
 	{
-		sbuf = strdup(newfragment);
+		sbuf = uri_strdup_(uri, newfragment);
 		if(!sbuf)
 		{
 			return -1;
 		}
 		newfragment = sbuf;
 	}
-	free(uri->fragment);
+	uri_recomposed_dirty_(uri, URI_COMPOSED_FRAGMENT_);
+	uri_free_(uri, uri->fragment);
 	uri->fragment = sbuf;
-	uri->uri.fragment.first = sbuf;
-	if(sbuf)
-	{
-		uri->uri.fragment.afterLast = strchr(sbuf, 0);
-	}
-	else
-	{
-		uri->uri.fragment.afterLast = NULL;
-	}
+	uri->fragmentlen = (sbuf ? strlen(sbuf) : 0);
 	return 0;
 }
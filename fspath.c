@@ -32,7 +32,7 @@ uri_create_cwd(void)
 	char *pathbuf;
 	URI *uri;
 	
-	pathbuf = (char *) calloc(1, 7 + PATH_MAX + 2);
+	pathbuf = (char *) uri_mem_calloc_(1, 7 + PATH_MAX + 2);
 	if(!pathbuf)
 	{
 		return NULL;
@@ -40,12 +40,12 @@ uri_create_cwd(void)
 	strcpy(pathbuf, "file://");
 	if(!getcwd(&(pathbuf[7]), PATH_MAX + 1))
 	{
-		free(pathbuf);
+		uri_mem_free_(pathbuf);
 		return NULL;
 	}
 	pathbuf[strlen(pathbuf)] = '/';
 	/* XXX encode special characters in the path */
 	uri = uri_create_str(pathbuf, NULL);
-	free(pathbuf);
+	uri_mem_free_(pathbuf);
 	return uri;
 }
@@ -30,26 +30,24 @@
 size_t
 uri_host(const URI *restrict uri, char *restrict buf, size_t buflen)
 {
-	if(!uri->hoststr)
-	{
-		if(buf && buflen)
-		{
-			*buf = 0;
-		}
-		return 0;
-	}
-	if(buf && buflen)
-	{
-		strncpy(buf, uri->hoststr, buflen - 1);
-		buf[buflen - 1] = 0;
-	}
-	return strlen(uri->hoststr) + 1;
+	uri_lazy_(uri, URI_LAZY_HOST_);
+	return uri_copy_(uri->hoststr, uri->hostlen, buf, buflen);
 }
 
 /* Return the host as const string pointer */
 const char *
 uri_host_str(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_HOST_);
+	return uri->hoststr;
+}
+
+/* Return the host as a pointer and length, without rescanning it */
+const char *
+uri_host_view(const URI *restrict uri, size_t *restrict len)
+{
+	uri_lazy_(uri, URI_LAZY_HOST_);
+	*len = uri->hostlen;
 	return uri->hoststr;
 }
 
@@ -59,6 +57,7 @@ uri_host_str(const URI *uri)
 char *
 uri_host_stralloc(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_HOST_);
 	if(!uri->hoststr)
 	{
 		errno = 0;
@@ -73,26 +72,30 @@ uri_set_host(URI *restrict uri, const char *restrict newhost)
 {
 	char *sbuf;
 
+	uri_lazy_(uri, URI_LAZY_HOST_);
 	sbuf = NULL;
 	if(newhost)
 	{
-		sbuf = strdup(newhost);
+		sbuf = uri_strdup_inline_(uri, newhost, uri->hostbuf, sizeof(uri->hostbuf));
 		if(!sbuf)
 		{
 			return -1;
 		}
 		newhost = sbuf;
 	}
-	free(uri->hoststr);
+	uri_recomposed_dirty_(uri, URI_COMPOSED_AUTHORITY_);
+	uri_free_(uri, uri->hoststr);
 	uri->hoststr = sbuf;
-	uri->uri.hostText.first = sbuf;
-	if(sbuf)
-	{
-		uri->uri.hostText.afterLast = strchr(sbuf, 0);
-	}
-	else
-	{
-		uri->uri.hostText.afterLast = NULL;
-	}
+	uri->hostlen = (sbuf ? strlen(sbuf) : 0);
+	/* The parsed form of an IP-literal host, and the text recomposed from
+	 * it, no longer apply
+	 */
+	uri_free_(uri, uri->hostdata.ip4);
+	uri_free_(uri, uri->hostdata.ip6);
+	uri_free_(uri, (char *) uri->hostdata.ipFuture.first);
+	uri_free_(uri, uri->hostlit);
+	memset(&(uri->hostdata), 0, sizeof(uri->hostdata));
+	uri->hostlit = NULL;
+	uri->hostlitlen = 0;
 	return 0;
 }
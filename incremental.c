@@ -0,0 +1,300 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* The incremental parser accepts a URI reference in arbitrarily-sized
+ * chunks. Each octet is checked as it arrives against the character class
+ * of the component it appears in, tracked by a small state machine whose
+ * position is retained between calls, so that invalid or oversized input
+ * is rejected without waiting for the rest of it. When the reference is
+ * complete, the accumulated octets are parsed in full by uri_parse_(),
+ * which also validates the structure of the authority.
+ */
+
+/* Parser states */
+#define URI_PS_START_                  0
+#define URI_PS_SCHEME_                 1
+#define URI_PS_HIER_                   2
+#define URI_PS_SLASH_                  3
+#define URI_PS_AUTH_                   4
+#define URI_PS_PATH_                   5
+#define URI_PS_QUERY_                  6
+#define URI_PS_FRAGMENT_               7
+
+/* The initial size of the accumulation buffer */
+#define URI_PS_BUFSIZE_                256
+
+static int uri_parser_octet_(URI_PARSER *parser, unsigned char ch);
+static int uri_parser_fail_(URI_PARSER *parser, int err);
+
+/* Create a new incremental parser. If maxlen is nonzero, any URI reference
+ * longer than maxlen octets will be rejected with EMSGSIZE.
+ */
+URI_PARSER *
+uri_parser_create(size_t maxlen)
+{
+	URI_PARSER *parser;
+
+	parser = (URI_PARSER *) uri_mem_calloc_(1, sizeof(URI_PARSER));
+	if(!parser)
+	{
+		return NULL;
+	}
+	parser->maxlen = maxlen;
+	return parser;
+}
+
+/* Destroy an incremental parser */
+int
+uri_parser_destroy(URI_PARSER *parser)
+{
+	if(parser)
+	{
+		uri_mem_free_(parser->buf);
+		uri_mem_free_(parser);
+	}
+	return 0;
+}
+
+/* Discard any input which has been fed to the parser, so that it can be
+ * used to parse another URI reference; its buffer is retained
+ */
+int
+uri_parser_reset(URI_PARSER *parser)
+{
+	parser->len = 0;
+	parser->state = URI_PS_START_;
+	parser->pct = 0;
+	parser->firstseg = 0;
+	parser->err = 0;
+	return 0;
+}
+
+/* Feed len octets of input to the parser. Returns 0 if the input received
+ * so far could form the beginning of a valid URI reference. Otherwise,
+ * returns -1 with errno set to EINVAL (invalid input), EMSGSIZE (the input
+ * exceeds the parser's maximum length) or ENOMEM; once this has occurred,
+ * all further input is rejected until the parser is reset.
+ */
+int
+uri_parser_feed(URI_PARSER *restrict parser, const char *restrict buf, size_t len)
+{
+	size_t needed, c;
+	char *p;
+
+	if(parser->err)
+	{
+		errno = parser->err;
+		return -1;
+	}
+	if(parser->maxlen && len > parser->maxlen - parser->len)
+	{
+		return uri_parser_fail_(parser, EMSGSIZE);
+	}
+	needed = parser->len + len;
+	if(needed > parser->size)
+	{
+		c = (parser->size ? parser->size : URI_PS_BUFSIZE_);
+		while(c < needed)
+		{
+			c *= 2;
+		}
+		p = (char *) uri_mem_realloc_(parser->buf, c);
+		if(!p)
+		{
+			return uri_parser_fail_(parser, ENOMEM);
+		}
+		parser->buf = p;
+		parser->size = c;
+	}
+	for(c = 0; c < len; c++)
+	{
+		if(uri_parser_octet_(parser, (unsigned char) buf[c]))
+		{
+			return uri_parser_fail_(parser, EINVAL);
+		}
+	}
+	memcpy(parser->buf + parser->len, buf, len);
+	parser->len += len;
+	return 0;
+}
+
+/* Complete parsing of the input fed to the parser, returning a new URI
+ * object (rebased against base, if it is non-NULL) which must be destroyed
+ * with uri_destroy(). Whether or not this succeeds, the parser is reset.
+ */
+URI *
+uri_parser_finish(URI_PARSER *restrict parser, const URI *restrict base)
+{
+	URI *uri;
+	int err;
+
+	if(parser->err)
+	{
+		err = parser->err;
+		uri_parser_reset(parser);
+		errno = err;
+		return NULL;
+	}
+	if(parser->pct)
+	{
+		/* The input ended part-way through a percent-encoded octet */
+		uri_parser_reset(parser);
+		errno = EINVAL;
+		return NULL;
+	}
+	/* If nothing has been fed, this is an empty relative reference */
+	uri = uri_parse_(parser->buf ? parser->buf : "", parser->len, base, NULL);
+	uri_parser_reset(parser);
+	return uri;
+}
+
+/* Internal: advance the state machine by a single octet, returning -1 if
+ * the octet cannot appear at this position
+ */
+static int
+uri_parser_octet_(URI_PARSER *parser, unsigned char ch)
+{
+	unsigned char cc;
+
+	cc = uri_cclass_[ch];
+	if(parser->pct)
+	{
+		if(!(cc & URI_CC_HEX_))
+		{
+			return -1;
+		}
+		parser->pct--;
+		return 0;
+	}
+	switch(parser->state)
+	{
+	case URI_PS_START_:
+		if(cc & URI_CC_ALPHA_)
+		{
+			/* Either a scheme or the first segment of a relative path */
+			parser->state = URI_PS_SCHEME_;
+			return 0;
+		}
+		/* A relative reference: the first path segment cannot contain
+		 * a colon
+		 */
+		parser->firstseg = 1;
+		parser->state = URI_PS_HIER_;
+		return uri_parser_octet_(parser, ch);
+	case URI_PS_SCHEME_:
+		if(cc & URI_CC_SCHEME_)
+		{
+			return 0;
+		}
+		if(ch == ':')
+		{
+			parser->state = URI_PS_HIER_;
+			return 0;
+		}
+		/* Not a scheme after all */
+		parser->firstseg = 1;
+		parser->state = URI_PS_PATH_;
+		return uri_parser_octet_(parser, ch);
+	case URI_PS_HIER_:
+		if(ch == '/')
+		{
+			parser->state = URI_PS_SLASH_;
+			return 0;
+		}
+		parser->state = URI_PS_PATH_;
+		return uri_parser_octet_(parser, ch);
+	case URI_PS_SLASH_:
+		parser->firstseg = 0;
+		if(ch == '/')
+		{
+			parser->state = URI_PS_AUTH_;
+			return 0;
+		}
+		parser->state = URI_PS_PATH_;
+		return uri_parser_octet_(parser, ch);
+	case URI_PS_AUTH_:
+		if(ch == '/' || ch == '?' || ch == '#')
+		{
+			parser->state = URI_PS_PATH_;
+			return uri_parser_octet_(parser, ch);
+		}
+		if(!(cc & URI_CC_USERINFO_) && ch != '@' && ch != '[' && ch != ']')
+		{
+			return -1;
+		}
+		break;
+	case URI_PS_PATH_:
+		if(ch == '?')
+		{
+			parser->state = URI_PS_QUERY_;
+			return 0;
+		}
+		if(ch == '#')
+		{
+			parser->state = URI_PS_FRAGMENT_;
+			return 0;
+		}
+		if(ch == '/')
+		{
+			parser->firstseg = 0;
+		}
+		else if(ch == ':' && parser->firstseg)
+		{
+			return -1;
+		}
+		if(!(cc & URI_CC_PATH_))
+		{
+			return -1;
+		}
+		break;
+	case URI_PS_QUERY_:
+		if(ch == '#')
+		{
+			parser->state = URI_PS_FRAGMENT_;
+			return 0;
+		}
+		/* Fall through */
+	case URI_PS_FRAGMENT_:
+		if(!(cc & URI_CC_QUERY_))
+		{
+			return -1;
+		}
+		break;
+	}
+	if(ch == '%')
+	{
+		parser->pct = 2;
+	}
+	return 0;
+}
+
+/* Internal: place the parser into the failed state */
+static int
+uri_parser_fail_(URI_PARSER *parser, int err)
+{
+	parser->err = err;
+	errno = err;
+	return -1;
+}
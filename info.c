@@ -34,12 +34,14 @@ URI_INFO *
 uri_info(const URI *uri)
 {
 	URI_INFO *p;
+	UriUriA mirror;
 	char *buf;
 	size_t buflen, r;
 
+	uri_mirror_(uri, &mirror);
 	buflen = 0;
 #define getbuf(component) \
-	r = uri_get_(&(uri->uri.component), NULL, 0);	  \
+	r = uri_get_(&(mirror.component), NULL, 0);	  \
 	if(r == (size_t) -1)							  \
 	{												  \
 		return NULL;								  \
@@ -59,20 +61,20 @@ uri_info(const URI *uri)
 	getbuf(fragment);
 
 #undef getbuf
-	p = (URI_INFO *) calloc(1, sizeof(URI_INFO));
+	p = (URI_INFO *) uri_mem_calloc_(1, sizeof(URI_INFO));
 	if(!p)
 	{
 		return NULL;
 	}
-	buf = (char *) calloc(1, buflen);
+	buf = (char *) uri_mem_calloc_(1, buflen);
 	if(!buf)
 	{
-		free(p);
+		uri_mem_free_(p);
 		return NULL;
 	}
 	p->internal.buffer = buf;
 #define getbuf(component, member)						\
-	r = uri_get_(&(uri->uri.component), buf, buflen);	\
+	r = uri_get_(&(mirror.component), buf, buflen);	\
 	if(r)												\
 	{													\
 		p->member = buf;								\
@@ -103,10 +105,10 @@ uri_info(const URI *uri)
 int
 uri_info_destroy(URI_INFO *info)
 {
-	free(info->internal.buffer);
-	free(info->user);
-	free(info->pass);
-	free(info);
+	uri_mem_free_(info->internal.buffer);
+	uri_mem_free_(info->user);
+	uri_mem_free_(info->pass);
+	uri_mem_free_(info);
 	return 0;
 }
 
@@ -146,7 +148,28 @@ uri_info_get_int(URI_INFO *info, const char *key, intmax_t defval)
 int
 uri_equal(const URI *a, const URI *b)
 {
-	return uriEqualsUriA(&(a->uri), &(b->uri));
+	UriUriA amirror, bmirror;
+
+	uri_lazy_(a, URI_LAZY_ALL_);
+	uri_lazy_(b, URI_LAZY_ALL_);
+	if((a->normalise == URI_PARSE_NORMALISE_LAZY && uri_normalise((URI *) a)) ||
+	   (b->normalise == URI_PARSE_NORMALISE_LAZY && uri_normalise((URI *) b)))
+	{
+		return 0;
+	}
+	/* If both URIs have been recomposed since they were last modified, the
+	 * same recomposed form means that they're equal
+	 */
+	if(__atomic_load_n(&(a->composedvalid), __ATOMIC_ACQUIRE) == URI_COMPOSED_COUNT_ &&
+	   __atomic_load_n(&(b->composedvalid), __ATOMIC_ACQUIRE) == URI_COMPOSED_COUNT_ &&
+	   a->composedoff[URI_COMPOSED_COUNT_] == b->composedoff[URI_COMPOSED_COUNT_] &&
+	   !memcmp(a->composed, b->composed, a->composedoff[URI_COMPOSED_COUNT_]))
+	{
+		return 1;
+	}
+	uri_mirror_(a, &amirror);
+	uri_mirror_(b, &bmirror);
+	return uriEqualsUriA(&amirror, &bmirror);
 }
 
 static ssize_t
@@ -195,7 +218,7 @@ uri_info_parseauth_(URI_INFO *info)
 	{
 		return 0;
 	}
-	info->user = strdup(info->auth);
+	info->user = uri_mem_strdup_(info->auth);
 	if(!info->user)
 	{
 		return -1;
@@ -236,7 +259,7 @@ uri_info_parseauth_(URI_INFO *info)
 	*p = 0;
 	if(*s == ':')
 	{
-		info->pass = strdup(s);
+		info->pass = uri_mem_strdup_(s);
 		if(!info->pass)
 		{
 			return -1;
@@ -291,7 +314,7 @@ uri_info_parseparams_(URI_INFO *info)
 	{
 		return 0;
 	}
-	qbuf = (char *) calloc(1, strlen(info->query) + 1);
+	qbuf = (char *) uri_mem_calloc_(1, strlen(info->query) + 1);
 	if(!qbuf)
 	{
 		return -1;
@@ -342,7 +365,7 @@ uri_info_parseparams_(URI_INFO *info)
 		}
 		s = t;
 	}
-	free(qbuf);
+	uri_mem_free_(qbuf);
 	return 0;
 }
 
@@ -361,7 +384,7 @@ uri_info_param_add_(URI_INFO *info, const char *key, const char *value)
 	{
 		/* Allocate in chunks of four parameters at a time plus sentinels */
 		const size_t npairs = 4;
-		p = (char **) realloc(info->params, (info->internal.nalloc + npairs + 1) * sizeof(char *) * 2);
+		p = (char **) uri_mem_realloc_(info->params, (info->internal.nalloc + npairs + 1) * sizeof(char *) * 2);
 		if(!p)
 		{
 			return -1;
@@ -370,8 +393,8 @@ uri_info_param_add_(URI_INFO *info, const char *key, const char *value)
 		info->params = p;
 		info->internal.nalloc += npairs;
 	}
-	info->params[n] = strdup(key);
-	info->params[n + 1] = strdup(value);
+	info->params[n] = uri_mem_strdup_(key);
+	info->params[n + 1] = uri_mem_strdup_(value);
 	if(!info->params[info->internal.nparams] || !info->params[info->internal.nparams + 1])
 	{
 		return -1;
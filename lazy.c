@@ -0,0 +1,254 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* Lazily-materialised URIs: when a URI is parsed with URI_PARSE_LAZY (and
+ * can be handled by the structural scanner), the source string is copied into the URI's
+ * storage block and only the component boundaries are recorded. Each
+ * component is copied out as a null-terminated string (and, for the path,
+ * split into segments) the first time that it is needed.
+ *
+ * The storage block holds the path segment array, then the copy of the
+ * source string, then an area of len + 7 bytes into which the components
+ * are materialised. Component n (in the order scheme, userinfo, host,
+ * port, path, query, fragment) is placed at the same offset within that
+ * area as it has within the source, plus n: because the components
+ * appear in the same order in the source and are separated by at least
+ * one delimiter, each fits without overlapping its neighbours, with room
+ * for a terminating null. Path segments are terminated in place of the
+ * slashes which separate them.
+ */
+
+static size_t uri_lazy_segments_(const struct uri_scan_struct *scan);
+static char *uri_lazy_copy_(URI *restrict uri, const UriTextRangeA *restrict range, size_t index, size_t *restrict len);
+static void uri_lazy_path_(URI *uri);
+
+/* Internal: create a lazily-materialised URI from the components located
+ * by the structural scanner within str[0..len-1]
+ */
+URI *
+uri_lazy_parse_(const struct uri_scan_struct *scan, const char *str, size_t len, struct uri_arena_struct *arena)
+{
+	URI *uri;
+	size_t nseg, segsize;
+	char *src;
+	const char *p;
+	long port;
+
+	nseg = uri_lazy_segments_(scan);
+	segsize = nseg * sizeof(UriPathSegmentA);
+	uri = uri_create_(segsize + len + 1 + len + 7, arena);
+	if(!uri)
+	{
+		return NULL;
+	}
+	src = uri->block + segsize;
+	memcpy(src, str, len);
+	src[len] = 0;
+	uri->srcstr = src;
+	uri->srclen = len;
+	/* Rebase the component ranges onto the copy of the source */
+	uri->src = *scan;
+#define URI_LAZY_REBASE_(range) \
+	if((range).first) \
+	{ \
+		(range).first = src + ((range).first - str); \
+		(range).afterLast = src + ((range).afterLast - str); \
+	}
+	URI_LAZY_REBASE_(uri->src.scheme);
+	URI_LAZY_REBASE_(uri->src.userinfo);
+	URI_LAZY_REBASE_(uri->src.host);
+	URI_LAZY_REBASE_(uri->src.port);
+	URI_LAZY_REBASE_(uri->src.path);
+	URI_LAZY_REBASE_(uri->src.query);
+	URI_LAZY_REBASE_(uri->src.fragment);
+#undef URI_LAZY_REBASE_
+	uri->lazy = URI_LAZY_ALL_;
+	uri->hier = 1;
+	uri->absolute = (scan->scheme.first ? 1 : 0);
+	uri->pathabs = (scan->path.first && !scan->host.first && *(scan->path.first) == '/');
+	/* Parse the port number, in the same way as uri_store_() */
+	if(scan->port.first)
+	{
+		port = 0;
+		for(p = scan->port.first; p < scan->port.afterLast && port <= 65535; p++)
+		{
+			port = (port * 10) + (*p - '0');
+		}
+		uri->port = (port < 1 || port > 65535 ? 0 : (int) port);
+	}
+	return uri;
+}
+
+/* Internal: materialise the components of a lazily-parsed URI indicated
+ * by which (a mask of URI_LAZY_xxx_ flags). Although this modifies the URI
+ * object, it doesn't change its value, and so may be applied to a const
+ * URI.
+ */
+int
+uri_lazy_(const URI *curi, unsigned int which)
+{
+	URI *uri;
+
+	uri = (URI *) curi;
+	which &= uri->lazy;
+	if(!which)
+	{
+		return 0;
+	}
+	if(which & URI_LAZY_SCHEME_)
+	{
+		uri->scheme = uri_lazy_copy_(uri, &(uri->src.scheme), 0, &(uri->schemelen));
+	}
+	if(which & URI_LAZY_AUTH_)
+	{
+		uri->auth = uri_lazy_copy_(uri, &(uri->src.userinfo), 1, &(uri->authlen));
+	}
+	if(which & URI_LAZY_HOST_)
+	{
+		uri->hoststr = uri_lazy_copy_(uri, &(uri->src.host), 2, &(uri->hostlen));
+	}
+	if(which & URI_LAZY_PORT_)
+	{
+		uri->portstr = uri_lazy_copy_(uri, &(uri->src.port), 3, &(uri->portlen));
+	}
+	if(which & URI_LAZY_PATH_)
+	{
+		uri_lazy_path_(uri);
+	}
+	if(which & URI_LAZY_QUERY_)
+	{
+		uri->query = uri_lazy_copy_(uri, &(uri->src.query), 5, &(uri->querylen));
+	}
+	if(which & URI_LAZY_FRAGMENT_)
+	{
+		uri->fragment = uri_lazy_copy_(uri, &(uri->src.fragment), 6, &(uri->fragmentlen));
+	}
+	uri->lazy &= ~which;
+	return 0;
+}
+
+/* Internal: determine the number of path segments which uri_lazy_path_()
+ * will produce; this matches the behaviour of uri_parse_scanned_()
+ */
+static size_t
+uri_lazy_segments_(const struct uri_scan_struct *scan)
+{
+	const char *p, *end;
+	size_t nseg;
+
+	if(!scan->path.first)
+	{
+		return 0;
+	}
+	p = scan->path.first;
+	end = scan->path.afterLast;
+	if(*p == '/')
+	{
+		p++;
+	}
+	if(p >= end && !scan->host.first)
+	{
+		return 0;
+	}
+	for(nseg = 1; (p = (const char *) memchr(p, '/', end - p)); p++)
+	{
+		nseg++;
+	}
+	return nseg;
+}
+
+/* Internal: copy component number index to the materialisation area,
+ * storing its length in *len
+ */
+static char *
+uri_lazy_copy_(URI *restrict uri, const UriTextRangeA *restrict range, size_t index, size_t *restrict len)
+{
+	char *dest;
+
+	if(!range->first)
+	{
+		*len = 0;
+		return NULL;
+	}
+	*len = range->afterLast - range->first;
+	dest = uri->srcstr + uri->srclen + 1 + (range->first - uri->srcstr) + index;
+	memcpy(dest, range->first, *len);
+	dest[*len] = 0;
+	return dest;
+}
+
+/* Internal: split the path of a lazy URI into segments, using the array at
+ * the start of the storage block
+ */
+static void
+uri_lazy_path_(URI *uri)
+{
+	UriPathSegmentA *seg, *prev;
+	UriTextRangeA range;
+	const char *p, *end, *t;
+	size_t len;
+
+	uri->pathfirst = uri->pathlast = uri->pathcur = NULL;
+	uri->pathcount = 0;
+	uri->pathlen = 0;
+	if(uri_lazy_segments_(&(uri->src)))
+	{
+		p = uri->src.path.first;
+		end = uri->src.path.afterLast;
+		if(*p == '/')
+		{
+			p++;
+		}
+		seg = (UriPathSegmentA *) uri->block;
+		prev = NULL;
+		for(;; seg++)
+		{
+			for(t = p; t < end && *t != '/'; t++);
+			memset(seg, 0, sizeof(UriPathSegmentA));
+			range.first = p;
+			range.afterLast = t;
+			seg->text.first = uri_lazy_copy_(uri, &range, 4, &len);
+			seg->text.afterLast = seg->text.first + len;
+			uri->pathlen += len + (prev ? 1 : 0);
+			if(prev)
+			{
+				prev->next = seg;
+			}
+			else
+			{
+				uri->pathfirst = seg;
+			}
+			prev = seg;
+			uri->pathcount++;
+			if(t >= end)
+			{
+				break;
+			}
+			p = t + 1;
+		}
+		uri->pathlast = prev;
+		uri->pathcur = uri->pathfirst;
+	}
+}
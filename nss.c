@@ -0,0 +1,71 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* 'nss' property accessors: the namespace-specific string is the opaque
+ * portion of a non-hierarchical URI following the scheme, excluding any
+ * query or fragment (for example, 'isbn:0451450523' in
+ * 'urn:isbn:0451450523'); it is absent for hierarchical URIs.
+ */
+
+size_t
+uri_nss(const URI *restrict uri, char *restrict buf, size_t buflen)
+{
+	const char *str;
+	size_t len;
+
+	str = uri_nss_view(uri, &len);
+	return uri_copy_(str, len, buf, buflen);
+}
+
+/* Return the NSS as const string pointer */
+const char *
+uri_nss_str(const URI *uri)
+{
+	return uri->nss;
+}
+
+/* Return the NSS as a pointer and length, without rescanning it; the NSS
+ * is always the text of the URI's only path segment
+ */
+const char *
+uri_nss_view(const URI *restrict uri, size_t *restrict len)
+{
+	*len = (uri->nss ? (size_t) (uri->pathfirst->text.afterLast - uri->pathfirst->text.first) : 0);
+	return uri->nss;
+}
+
+/* Return the NSS as a newly-allocated string (which must be freed by the
+ * caller)
+ */
+char *
+uri_nss_stralloc(const URI *uri)
+{
+	if(!uri->nss)
+	{
+		errno = 0;
+		return NULL;
+	}
+	return strdup(uri->nss);
+}
@@ -28,6 +28,7 @@
 # include <wchar.h>
 # include <errno.h>
 # include <limits.h>
+# include <pthread.h>
 
 # include "uriparser/Uri.h"
 
@@ -40,10 +41,123 @@ struct uri_info_internal_data_struct
 
 # include "URI.h"
 
+/* A region allocator; see arena.c */
+struct uri_arena_struct
+{
+	struct uri_arena_chunk_struct *chunks;
+	/* The allocator from which chunks are obtained, or NULL for the
+	 * global allocator
+	 */
+	const URI_ALLOCATOR *allocator;
+};
+
+/* An allocation context; see alloc.c */
+struct uri_context_struct
+{
+	struct uri_arena_struct arena;
+	URI_ALLOCATOR allocator;
+	/* The context which was current when this one was entered */
+	struct uri_context_struct *prev;
+	int entered;
+};
+
+struct uri_batch_struct
+{
+	/* The arena from which the URIs (and this array) are allocated */
+	struct uri_arena_struct arena;
+	size_t count;
+	URI **uris;
+	/* Additional arenas, one per worker thread in a parallel batch (the
+	 * calling thread uses the arena above)
+	 */
+	struct uri_arena_struct *arenas;
+	size_t narenas;
+};
+
+struct uri_resolver_struct
+{
+	/* A duplicate of the base URI, which keeps its storage block alive */
+	URI *base;
+	/* The components of the base, in the form in which they are merged
+	 * with each reference
+	 */
+	UriUriA mirror;
+	/* Nonzero if references can be merged with the base directly, rather
+	 * than being parsed and rebased individually
+	 */
+	int direct;
+};
+
+/* Character classes used by the structural scanner */
+# define URI_CC_SCHEME_                 (1<<0)
+# define URI_CC_USERINFO_               (1<<1)
+# define URI_CC_HOST_                   (1<<2)
+# define URI_CC_PATH_                   (1<<3)
+# define URI_CC_QUERY_                  (1<<4)
+# define URI_CC_HEX_                    (1<<5)
+# define URI_CC_ALPHA_                  (1<<6)
+# define URI_CC_DIGIT_                  (1<<7)
+
+/* The maximum number of path segments which uri_create_ascii() will
+ * process without involving uriparser
+ */
+# define URI_SCAN_MAXSEGS_              32
+
+/* The number of path segments which can be merged when resolving a
+ * reference without allocating
+ */
+# define URI_REBASE_SEGS_               32
+
+/* Flags set by the structural scanner */
+# define URI_SCAN_IPLITERAL_            (1<<0)
+# define URI_SCAN_PCT_                  (1<<1)
+
+/* The component boundaries of a URI reference located by uri_scan_(); any
+ * range whose first member is NULL is absent.
+ */
+struct uri_scan_struct
+{
+	UriTextRangeA scheme;
+	UriTextRangeA userinfo;
+	UriTextRangeA host;
+	UriTextRangeA port;
+	UriTextRangeA path;
+	UriTextRangeA query;
+	UriTextRangeA fragment;
+	unsigned int flags;
+};
+
+/* Components of a lazily-parsed URI which have yet to be materialised;
+ * see lazy.c
+ */
+# define URI_LAZY_SCHEME_               (1<<0)
+# define URI_LAZY_AUTH_                 (1<<1)
+# define URI_LAZY_HOST_                 (1<<2)
+# define URI_LAZY_PORT_                 (1<<3)
+# define URI_LAZY_PATH_                 (1<<4)
+# define URI_LAZY_QUERY_                (1<<5)
+# define URI_LAZY_FRAGMENT_             (1<<6)
+# define URI_LAZY_ALL_                  0x7f
+
+/* The components of the recomposed form of a URI, in the order in which
+ * they appear; see recompose.c
+ */
+# define URI_COMPOSED_SCHEME_           0
+# define URI_COMPOSED_AUTHORITY_        1
+# define URI_COMPOSED_PATH_             2
+# define URI_COMPOSED_QUERY_            3
+# define URI_COMPOSED_FRAGMENT_         4
+# define URI_COMPOSED_COUNT_            5
+
+/* The sizes of the buffers within the URI object which hold short scheme,
+ * host and port strings set after parsing, including the terminating null
+ */
+# define URI_INLINE_SCHEME_             16
+# define URI_INLINE_HOST_               24
+# define URI_INLINE_PORT_               8
+
 struct uri_struct
 {
-	/* A uriparser URI instance */
-	UriUriA uri;
 	/* Any of the below members may be NULL to indicate absence */
 	/* The URI scheme, e.g., 'http' */
 	char *scheme;
@@ -57,6 +171,11 @@ struct uri_struct
 	char *hoststr;
 	/* The hostname as a structure */
 	struct UriHostDataStructA hostdata;
+	/* If the host is an IP literal, the text which uriparser recomposes
+	 * from hostdata (e.g., '[0000:...:0001]'), held in the storage block
+	 */
+	char *hostlit;
+	size_t hostlitlen;
 	/* The port, as a string */
 	char *portstr;
 	/* The port parsed as an unsigned integer */
@@ -69,10 +188,13 @@ struct uri_struct
 	char *nss;
 	/* The path; the first segment points to the start of the buffer; the
 	 * remaining segments in the list point to sections within that same
-	 * buffer.
+	 * buffer. The segments are always laid out as a contiguous array of
+	 * pathcount entries (as well as being linked together for the benefit
+	 * of uriparser), and so can be indexed directly.
 	 */
 	UriPathSegmentA *pathfirst;
 	UriPathSegmentA *pathlast;
+	size_t pathcount;
 	/* Is the path absolute? */
 	int pathabs;
 	/* The current path pointer (used with uri_peek(), uri_consume() and
@@ -83,23 +205,148 @@ struct uri_struct
 	char *query;
 	/* The fragment identifier */
 	char *fragment;
-	/* The complete URI in normalised form */
+	/* The lengths of scheme, auth, hoststr, portstr, query and fragment,
+	 * not including the terminating null, so that they need never be
+	 * rescanned; each is zero if the corresponding member is NULL
+	 */
+	size_t schemelen;
+	size_t authlen;
+	size_t hostlen;
+	size_t portlen;
+	size_t querylen;
+	size_t fragmentlen;
+	/* The combined length of the path segments and the slashes which
+	 * separate them, not including any leading slash
+	 */
+	size_t pathlen;
+	/* The complete URI as recomposed by uri_str(), which is reused until
+	 * one of its components changes: composedoff[] holds the offset at
+	 * which each component (URI_COMPOSED_xxx_) begins, followed by the
+	 * total length, and composedvalid is the number of leading components
+	 * which are still current, so that only those from the first changed
+	 * component onwards need to be recomposed. composing is set while
+	 * one thread brings the cached form up to date.
+	 */
 	char *composed;
+	size_t composedsize;
+	size_t composedoff[URI_COMPOSED_COUNT_ + 1];
+	unsigned int composedvalid;
+	int composing;
 	/* Is this URI absolute? */
 	int absolute;
 	/* Is this URI hierarchical? (http, file and ftp are; urn, tag and 
 	 * about aren't)
 	*/
 	int hier;
+	/* The storage block holding the path segments, host data and component
+	 * strings of a parsed URI; any member which points within the block must
+	 * not be passed to free(). The block may immediately follow the URI
+	 * object itself in the same heap allocation.
+	 */
+	char *block;
+	size_t blocksize;
+	/* If non-NULL, the arena from which this URI and its storage block were
+	 * allocated; the URI is released along with the arena rather than
+	 * by uri_destroy()
+	 */
+	struct uri_arena_struct *arena;
+	/* The URI_LAZY_xxx_ flags for those components of a lazily-parsed URI
+	 * which have not yet been copied out of srcstr; see lazy.c
+	 */
+	unsigned int lazy;
+	struct uri_scan_struct src;
+	char *srcstr;
+	size_t srclen;
+	/* When this URI should be normalised (URI_PARSE_NORMALISE_xxx) */
+	unsigned int normalise;
+	/* Is this URI known to be in normal form? */
+	int normalised;
+	/* If non-NULL, the URI object which owns the storage block that this
+	 * URI shares (see uri_dup_())
+	 */
+	URI *owner;
+	/* The number of references to this object: one for the object itself
+	 * until it is destroyed, plus one for each URI sharing its storage
+	 */
+	unsigned long refs;
+	/* The storage block which this object shares with its duplicates; it
+	 * is never modified, and is released along with the object itself
+	 * once no references remain
+	 */
+	char *sharedblock;
+	/* Short components set after parsing are stored in these buffers
+	 * instead of being allocated individually; as with the storage block,
+	 * any member which points within the URI object itself must not be
+	 * passed to free()
+	 */
+	char schemebuf[URI_INLINE_SCHEME_];
+	char hostbuf[URI_INLINE_HOST_];
+	char portbuf[URI_INLINE_PORT_];
 };
 
-URI *uri_create_(void);
+/* The state of an incremental parser; see incremental.c */
+struct uri_parser_struct
+{
+	/* The input accumulated so far */
+	char *buf;
+	size_t len;
+	size_t size;
+	/* The maximum length of input which will be accepted, or zero */
+	size_t maxlen;
+	/* The position of the state machine */
+	int state;
+	/* The number of hex digits of a percent-encoded octet still expected */
+	int pct;
+	/* Nonzero if the input is within the first segment of a relative path */
+	int firstseg;
+	/* If nonzero, the errno value with which the input was rejected */
+	int err;
+};
+
+extern const unsigned char uri_cclass_[256];
+
+URI *uri_create_(size_t storage, struct uri_arena_struct *arena);
+URI *uri_parse_(const char *str, size_t len, const URI *base, struct uri_arena_struct *arena);
 URI *uri_dup_(const URI *src);
 int uri_reset_(URI *uri);
-int uri_postparse_(URI *uri);
-int uri_postparse_set_(URI *uri);
+int uri_clear_(URI *uri);
+void uri_move_(URI *restrict uri, const URI *restrict src);
+void uri_release_(URI *uri);
+int uri_shared_(const URI *uri);
+void uri_free_(URI *uri, void *ptr);
+size_t uri_copy_(const char *restrict str, size_t len, char *restrict buf, size_t buflen);
+int uri_postparse_(URI *restrict uri, UriUriA *restrict parsed);
+void uri_mirror_(const URI *restrict uri, UriUriA *restrict dest);
+
+size_t uri_store_size_(const UriUriA *src);
+size_t uri_recompose_(const UriUriA *restrict src, char *restrict buf, size_t buflen);
+void uri_recomposed_dirty_(URI *uri, unsigned int component);
+size_t uri_composed_len_(const URI *restrict uri, UriUriA *restrict authority);
+void uri_composed_write_(const URI *restrict uri, const UriUriA *restrict authority, char *restrict p);
+int uri_store_(URI *uri, const UriUriA *src);
+
+void *uri_mem_alloc_(size_t size);
+void *uri_mem_calloc_(size_t nmemb, size_t size);
+void *uri_mem_realloc_(void *ptr, size_t size);
+void uri_mem_free_(void *ptr);
+char *uri_mem_strdup_(const char *src);
+char *uri_strdup_(URI *uri, const char *src);
+char *uri_strndup_(URI *restrict uri, const char *restrict src, size_t len);
+char *uri_strdup_inline_(URI *restrict uri, const char *src, char *buf, size_t bufsize);
+struct uri_arena_struct *uri_context_arena_(void);
+
+void *uri_arena_alloc_(struct uri_arena_struct *arena, size_t size);
+void uri_arena_destroy_(struct uri_arena_struct *arena);
+
+int uri_preprocess_ustr_(const unsigned char *restrict ustr, size_t len, char *restrict *restrict buf, size_t *restrict buflen);
+
+URI *uri_lazy_parse_(const struct uri_scan_struct *scan, const char *str, size_t len, struct uri_arena_struct *arena);
+int uri_lazy_(const URI *uri, unsigned int which);
+
+int uri_scan_(const char *str, size_t len, struct uri_scan_struct *restrict scan);
+int uri_scan_normal_(const struct uri_scan_struct *scan);
+int uri_scan_split_(const struct uri_scan_struct *restrict scan, UriUriA *restrict dest, UriPathSegmentA *restrict segs, size_t *restrict nseg);
 
-int uri_hostdata_copy_(struct UriHostDataStructA *restrict dest, const struct UriHostDataStructA *restrict src);
-int uri_path_copy_(URI *dest, const UriPathSegmentA *head);
+int uri_resolve_(UriUriA *restrict target, const UriUriA *ref, size_t refcount, const UriUriA *base, size_t basecount, UriPathSegmentA *segbuf, UriPathSegmentA **segs);
 
 #endif /*!P_LIBURI_H_*/
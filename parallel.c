@@ -0,0 +1,348 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* Parallel batch parsing: the input is divided into one contiguous range
+ * of indices per worker. Each worker consumes its own range from the
+ * front; once it is exhausted, the worker steals the back half of another
+ * worker's remaining range. Because each result is stored at the index of
+ * its input string, the batch is in input order regardless of which
+ * worker parsed which entry. Each worker allocates from its own arena, as
+ * arenas are not thread-safe.
+ */
+
+struct uri_pool_range_struct
+{
+	pthread_mutex_t lock;
+	size_t head;
+	size_t tail;
+};
+
+struct uri_pool_struct
+{
+	const unsigned char *const *strs;
+	/* If non-NULL, the lengths of each of strs; otherwise each of strs is
+	 * NUL-terminated
+	 */
+	const size_t *lens;
+	const URI *base;
+	URI_BATCH *batch;
+	size_t nworkers;
+	struct uri_pool_range_struct *ranges;
+	/* Set if any worker fails to allocate memory */
+	int failed;
+};
+
+struct uri_pool_worker_struct
+{
+	struct uri_pool_struct *pool;
+	size_t index;
+	struct uri_arena_struct *arena;
+};
+
+static URI_BATCH *uri_pool_run_(const unsigned char *const *strs, const size_t *lens, size_t count, const URI *base, unsigned nthreads);
+static void *uri_pool_worker_(void *arg);
+static int uri_pool_take_(struct uri_pool_struct *pool, size_t index, size_t *entry);
+static int uri_pool_steal_(struct uri_pool_struct *pool, size_t index);
+
+/* Parse an array of UTF-8 strings in the same way as uri_batch_create(),
+ * using up to nthreads threads (including the calling thread); if
+ * nthreads is zero, one thread per online processor is used
+ */
+URI_BATCH *
+uri_batch_create_parallel(const unsigned char *const *restrict strs, size_t count, const URI *restrict base, unsigned nthreads)
+{
+	return uri_pool_run_(strs, NULL, count, base, nthreads);
+}
+
+/* Parse a buffer containing newline-separated UTF-8 strings, with each
+ * line becoming an entry in the resulting batch. A carriage return
+ * preceding a newline is ignored, as is a final newline at the end of
+ * the buffer.
+ */
+URI_BATCH *
+uri_batch_create_lines(const unsigned char *restrict buf, size_t len, const URI *restrict base, unsigned nthreads)
+{
+	const unsigned char **strs;
+	const unsigned char *p, *end, *nl;
+	size_t *lens;
+	size_t count, c;
+	URI_BATCH *batch;
+
+	end = buf + len;
+	count = 0;
+	for(p = buf; p < end; p = nl + 1)
+	{
+		nl = (const unsigned char *) memchr(p, '\n', end - p);
+		count++;
+		if(!nl)
+		{
+			break;
+		}
+	}
+	strs = (const unsigned char **) uri_mem_alloc_((count ? count : 1) * sizeof(unsigned char *));
+	lens = (size_t *) uri_mem_alloc_((count ? count : 1) * sizeof(size_t));
+	if(!strs || !lens)
+	{
+		uri_mem_free_(strs);
+		uri_mem_free_(lens);
+		return NULL;
+	}
+	c = 0;
+	for(p = buf; p < end; p = nl + 1)
+	{
+		nl = (const unsigned char *) memchr(p, '\n', end - p);
+		strs[c] = p;
+		lens[c] = (nl ? nl : end) - p;
+		if(lens[c] && p[lens[c] - 1] == '\r')
+		{
+			lens[c]--;
+		}
+		c++;
+		if(!nl)
+		{
+			break;
+		}
+	}
+	batch = uri_pool_run_(strs, lens, count, base, nthreads);
+	uri_mem_free_(strs);
+	uri_mem_free_(lens);
+	return batch;
+}
+
+/* Internal: create a batch and parse strs into it using a pool of
+ * threads
+ */
+static URI_BATCH *
+uri_pool_run_(const unsigned char *const *strs, const size_t *lens, size_t count, const URI *base, unsigned nthreads)
+{
+	struct uri_pool_struct pool;
+	struct uri_pool_worker_struct *workers;
+	pthread_t *threads;
+	size_t c, nworkers, started, per;
+	long ncpu;
+	URI_BATCH *batch;
+
+	if(!nthreads)
+	{
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpu > 0 ? (unsigned) ncpu : 1);
+	}
+	nworkers = nthreads;
+	if(nworkers > count)
+	{
+		nworkers = (count ? count : 1);
+	}
+	batch = (URI_BATCH *) uri_mem_calloc_(1, sizeof(URI_BATCH));
+	if(!batch)
+	{
+		return NULL;
+	}
+	batch->count = count;
+	if(count)
+	{
+		batch->uris = (URI **) uri_arena_alloc_(&(batch->arena), count * sizeof(URI *));
+		if(!batch->uris)
+		{
+			uri_batch_destroy(batch);
+			return NULL;
+		}
+	}
+	if(nworkers > 1)
+	{
+		batch->arenas = (struct uri_arena_struct *) uri_mem_calloc_(nworkers - 1, sizeof(struct uri_arena_struct));
+		if(!batch->arenas)
+		{
+			uri_batch_destroy(batch);
+			return NULL;
+		}
+		batch->narenas = nworkers - 1;
+	}
+	/* The base is shared by every worker, and so any lazily-parsed
+	 * components are materialised now rather than by whichever workers
+	 * happen to use it first
+	 */
+	if(base)
+	{
+		uri_lazy_(base, URI_LAZY_ALL_);
+	}
+	memset(&pool, 0, sizeof(pool));
+	pool.strs = strs;
+	pool.lens = lens;
+	pool.base = base;
+	pool.batch = batch;
+	pool.nworkers = nworkers;
+	pool.ranges = (struct uri_pool_range_struct *) uri_mem_calloc_(nworkers, sizeof(struct uri_pool_range_struct));
+	workers = (struct uri_pool_worker_struct *) uri_mem_calloc_(nworkers, sizeof(struct uri_pool_worker_struct));
+	threads = (pthread_t *) uri_mem_calloc_(nworkers, sizeof(pthread_t));
+	if(!pool.ranges || !workers || !threads)
+	{
+		uri_mem_free_(pool.ranges);
+		uri_mem_free_(workers);
+		uri_mem_free_(threads);
+		uri_batch_destroy(batch);
+		return NULL;
+	}
+	/* Divide the input evenly between the workers to begin with */
+	per = count / nworkers;
+	for(c = 0; c < nworkers; c++)
+	{
+		pthread_mutex_init(&(pool.ranges[c].lock), NULL);
+		pool.ranges[c].head = c * per;
+		pool.ranges[c].tail = (c + 1 == nworkers ? count : (c + 1) * per);
+		workers[c].pool = &pool;
+		workers[c].index = c;
+		workers[c].arena = (c ? &(batch->arenas[c - 1]) : &(batch->arena));
+	}
+	/* The calling thread is worker zero; if a thread cannot be started,
+	 * its range will be stolen by the workers which were
+	 */
+	started = 1;
+	for(c = 1; c < nworkers; c++)
+	{
+		if(pthread_create(&(threads[c]), NULL, uri_pool_worker_, &(workers[c])))
+		{
+			break;
+		}
+		started++;
+	}
+	uri_pool_worker_(&(workers[0]));
+	for(c = 1; c < started; c++)
+	{
+		pthread_join(threads[c], NULL);
+	}
+	for(c = 0; c < nworkers; c++)
+	{
+		pthread_mutex_destroy(&(pool.ranges[c].lock));
+	}
+	uri_mem_free_(pool.ranges);
+	uri_mem_free_(workers);
+	uri_mem_free_(threads);
+	if(pool.failed)
+	{
+		uri_batch_destroy(batch);
+		errno = ENOMEM;
+		return NULL;
+	}
+	return batch;
+}
+
+/* Internal: the body of each worker thread */
+static void *
+uri_pool_worker_(void *arg)
+{
+	struct uri_pool_worker_struct *worker;
+	struct uri_pool_struct *pool;
+	char *buf;
+	size_t buflen, entry, len;
+
+	worker = (struct uri_pool_worker_struct *) arg;
+	pool = worker->pool;
+	buf = NULL;
+	buflen = 0;
+	while(!__atomic_load_n(&(pool->failed), __ATOMIC_RELAXED))
+	{
+		if(uri_pool_take_(pool, worker->index, &entry))
+		{
+			if(uri_pool_steal_(pool, worker->index))
+			{
+				continue;
+			}
+			/* There is nothing left to steal */
+			break;
+		}
+		len = (pool->lens ? pool->lens[entry] : strlen((const char *) pool->strs[entry]));
+		if(uri_preprocess_ustr_(pool->strs[entry], len, &buf, &buflen))
+		{
+			if(errno == ENOMEM)
+			{
+				__atomic_store_n(&(pool->failed), 1, __ATOMIC_RELAXED);
+			}
+			continue;
+		}
+		pool->batch->uris[entry] = uri_parse_(buf, strlen(buf), pool->base, worker->arena);
+	}
+	uri_mem_free_(buf);
+	return NULL;
+}
+
+/* Internal: take the next entry from the front of a worker's own range,
+ * returning -1 if the range is empty
+ */
+static int
+uri_pool_take_(struct uri_pool_struct *pool, size_t index, size_t *entry)
+{
+	struct uri_pool_range_struct *range;
+	int r;
+
+	range = &(pool->ranges[index]);
+	pthread_mutex_lock(&(range->lock));
+	if(range->head < range->tail)
+	{
+		*entry = range->head;
+		range->head++;
+		r = 0;
+	}
+	else
+	{
+		r = -1;
+	}
+	pthread_mutex_unlock(&(range->lock));
+	return r;
+}
+
+/* Internal: move the back half of another worker's range into the range
+ * belonging to worker index, returning nonzero if anything was stolen
+ */
+static int
+uri_pool_steal_(struct uri_pool_struct *pool, size_t index)
+{
+	struct uri_pool_range_struct *victim, *own;
+	size_t c, head, tail;
+
+	own = &(pool->ranges[index]);
+	for(c = 1; c < pool->nworkers; c++)
+	{
+		victim = &(pool->ranges[(index + c) % pool->nworkers]);
+		pthread_mutex_lock(&(victim->lock));
+		if(victim->head >= victim->tail)
+		{
+			pthread_mutex_unlock(&(victim->lock));
+			continue;
+		}
+		/* Take the back half (rounded up), so that a range of a single
+		 * entry is taken in its entirety
+		 */
+		head = victim->head + (victim->tail - victim->head) / 2;
+		tail = victim->tail;
+		victim->tail = head;
+		pthread_mutex_unlock(&(victim->lock));
+		pthread_mutex_lock(&(own->lock));
+		own->head = head;
+		own->tail = tail;
+		pthread_mutex_unlock(&(own->lock));
+		return 1;
+	}
+	return 0;
+}
@@ -25,12 +25,21 @@
 
 #include "p_liburi.h"
 
-static const char *uri_schemeend_(const char *str);
-static int uri_parse_nonhier_(URI *restrict dest, const char *uristr);
+static URI *uri_parse_dest_(URI *dest, const char *str, size_t len, const URI *base, unsigned int flags, struct uri_arena_struct *arena);
+static URI *uri_parse_samedoc_(const char *str, size_t len, const URI *base, unsigned int mode);
+static URI *uri_parse_scanned_(URI *dest, const struct uri_scan_struct *scan, struct uri_arena_struct *arena);
+static URI *uri_parse_uriparser_(URI *dest, const char *str, size_t len, int normalise, struct uri_arena_struct *arena);
+static URI *uri_parse_target_(URI *dest, size_t storage, struct uri_arena_struct *arena);
+static void uri_parse_discard_(URI *dest, URI *uri);
+static int uri_scan_simple_(const struct uri_scan_struct *scan);
+static const char *uri_schemeend_(const char *str, size_t len);
+static URI *uri_parse_nonhier_(URI *dest, const struct uri_scan_struct *scan, int normalise, struct uri_arena_struct *arena);
+static int uri_normalise_nonhier_(URI *uri);
 
-static char *uri_range_copy_(const UriTextRangeA *range);
-static int uri_range_set_(UriTextRangeA *restrict range, const char *restrict src);
-static int uri_path_copy_ref_(UriPathSegmentA **head, UriPathSegmentA **tail, const UriPathSegmentA *src);
+static size_t uri_range_size_(const UriTextRangeA *range);
+static char *uri_range_store_(char *restrict *restrict p, const UriTextRangeA *restrict range, size_t *restrict len);
+static void uri_range_set_(UriTextRangeA *restrict range, const char *restrict src, size_t len);
+static size_t uri_store_hostlit_(const UriUriA *src, char *buf);
 
 /* Create a URI from a 7-bit ASCII string, which we consider to be the
  * native form.
@@ -40,63 +49,586 @@ static int uri_path_copy_ref_(UriPathSegmentA **head, UriPathSegmentA **tail, co
 URI *
 uri_create_ascii(const char *restrict str, const URI *restrict base)
 {
+	return uri_parse_(str, strlen(str), base, NULL);
+}
+
+/* Create a URI from the first len characters of a 7-bit ASCII string,
+ * which need not be null-terminated
+ */
+URI *
+uri_create_ascii_n(const char *restrict str, size_t len, const URI *restrict base)
+{
+	return uri_parse_(str, len, base, NULL);
+}
+
+/* Create a URI from the first len characters of a 7-bit ASCII string,
+ * modifying the parser's behaviour according to flags:
+ *
+ * URI_PARSE_LAZY: defer copying each component of the URI until it is
+ *   first accessed. Because accessing the URI may then modify it, a URI
+ *   parsed this way must not be used concurrently by multiple threads.
+ *
+ * URI_PARSE_NORMALISE_NONE: don't normalise the syntax of the URI (unless
+ *   uri_normalise() is called); components are returned as they appeared
+ *   in the source string.
+ *
+ * URI_PARSE_NORMALISE_LAZY: normalise the syntax of the URI when it is
+ *   first recomposed or compared, rather than when it is parsed. As with
+ *   URI_PARSE_LAZY, the URI must not be used concurrently by multiple
+ *   threads until this has happened.
+ *
+ * If neither of the URI_PARSE_NORMALISE_xxx flags is specified, the URI is
+ * normalised as it is parsed, as uri_create_ascii() does.
+ */
+URI *
+uri_create_ascii_ex(const char *restrict str, size_t len, const URI *restrict base, unsigned int flags)
+{
+	if((flags & URI_PARSE_NORMALISE_MASK) == URI_PARSE_NORMALISE_MASK)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	return uri_parse_dest_(NULL, str, len, base, flags, NULL);
+}
+
+/* Normalise the syntax of a URI, unless it is already known to be in normal
+ * form; this is only needed for URIs created with URI_PARSE_NORMALISE_NONE
+ * or URI_PARSE_NORMALISE_LAZY. If normalisation fails, the URI is left
+ * empty.
+ */
+int
+uri_normalise(URI *uri)
+{
+	UriUriA mirror;
+	char *buf;
+	int bufsize;
+	unsigned int mode;
+	URI *r;
+
+	if(uri->normalised)
+	{
+		return 0;
+	}
+	uri_lazy_(uri, URI_LAZY_ALL_);
+	if(!uri->hier)
+	{
+		uri_recomposed_dirty_(uri, URI_COMPOSED_SCHEME_);
+		return uri_normalise_nonhier_(uri);
+	}
+	/* Recompose the URI and parse the result back into the same object,
+	 * which will normalise it and store the result in the existing block
+	 * if there's room
+	 */
+	uri_mirror_(uri, &mirror);
+	if(uriToStringCharsRequiredA(&mirror, &bufsize) != URI_SUCCESS)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	bufsize++;
+	buf = (char *) uri_mem_alloc_(bufsize);
+	if(!buf)
+	{
+		return -1;
+	}
+	if(uriToStringA(buf, &mirror, bufsize, NULL) != URI_SUCCESS)
+	{
+		uri_mem_free_(buf);
+		errno = EINVAL;
+		return -1;
+	}
+	mode = uri->normalise;
+	uri_clear_(uri);
+	r = uri_parse_dest_(uri, buf, strlen(buf), NULL, 0, uri->arena);
+	uri_mem_free_(buf);
+	if(!r)
+	{
+		return -1;
+	}
+	uri->normalise = mode;
+	return 0;
+}
+
+/* Returns nonzero if a URI is known to be in normal form */
+int
+uri_normalised(const URI *uri)
+{
+	return uri->normalised;
+}
+
+/* Parse a 7-bit ASCII string into an existing URI object, replacing its
+ * contents. The memory already allocated to the URI is reused where
+ * possible, so that a single object can be used to parse a sequence of
+ * URIs without allocating memory each time. If parsing fails, the URI is
+ * left empty.
+ */
+int
+uri_parse_into(URI *restrict uri, const char *restrict str, const URI *restrict base)
+{
+	return uri_parse_into_n(uri, str, strlen(str), base);
+}
+
+/* As uri_parse_into(), parsing the first len characters of str */
+int
+uri_parse_into_n(URI *restrict uri, const char *restrict str, size_t len, const URI *restrict base)
+{
+	uri_clear_(uri);
+	if(!uri_parse_dest_(uri, str, len, base, 0, uri->arena))
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/* Internal: parse len characters of an ASCII string and rebase the result
+ * against base (which may be NULL); if arena is non-NULL, the URI is
+ * allocated from it
+ */
+URI *
+uri_parse_(const char *str, size_t len, const URI *base, struct uri_arena_struct *arena)
+{
+	return uri_parse_dest_(NULL, str, len, base, 0, arena);
+}
+
+/* Internal: parse a string as uri_parse_(), storing the result in dest
+ * (which must be empty) if it is non-NULL, or in a new URI otherwise
+ */
+static URI *
+uri_parse_dest_(URI *dest, const char *str, size_t len, const URI *base, unsigned int flags, struct uri_arena_struct *arena)
+{
+	struct uri_scan_struct scan;
 	URI *uri;
-	UriParserStateA state;
-	const char *t;
-	
-	uri = uri_create_();
+	unsigned int mode;
+	int normal;
+
+	uri = NULL;
+	mode = flags & URI_PARSE_NORMALISE_MASK;
+	/* A reference consisting only of a query and/or fragment differs
+	 * from its base in at most two components, so it can be resolved
+	 * without parsing or rebasing anything
+	 */
+	if(base && !dest && !arena && len && (str[0] == '?' || str[0] == '#'))
+	{
+		uri = uri_parse_samedoc_(str, len, base, mode);
+		if(uri || errno)
+		{
+			return uri;
+		}
+	}
+	/* Locate the components using the structural scanner first; if the
+	 * URI is hierarchical and already in normal form (or doesn't need to
+	 * be), it can be stored directly, otherwise (or if the scanner rejects
+	 * it) uriparser is used instead. A scheme which isn't followed by a
+	 * slash indicates a non-hierarchical URI, which uriparser isn't
+	 * involved in parsing at all.
+	 */
+	if(uri_scan_(str, len, &scan))
+	{
+		/* Fall through to uriparser */
+	}
+	else if(scan.scheme.first &&
+			!(scan.scheme.afterLast + 1 < str + len && scan.scheme.afterLast[1] == '/'))
+	{
+		uri = uri_parse_nonhier_(dest, &scan, (mode == URI_PARSE_NORMALISE_EAGER), arena);
+		if(!uri)
+		{
+			return NULL;
+		}
+	}
+	else
+	{
+		normal = uri_scan_normal_(&scan);
+		if(normal || (mode != URI_PARSE_NORMALISE_EAGER && uri_scan_simple_(&scan)))
+		{
+			if((flags & URI_PARSE_LAZY) && !dest)
+			{
+				uri = uri_lazy_parse_(&scan, str, len, arena);
+				if(!uri)
+				{
+					return NULL;
+				}
+			}
+			else
+			{
+				uri = uri_parse_scanned_(dest, &scan, arena);
+			}
+			if(!uri && errno)
+			{
+				return NULL;
+			}
+			if(uri)
+			{
+				uri->normalised = normal;
+			}
+		}
+	}
+	if(!uri)
+	{
+		uri = uri_parse_uriparser_(dest, str, len, (mode == URI_PARSE_NORMALISE_EAGER), arena);
+		if(!uri)
+		{
+			return NULL;
+		}
+	}
+	uri->normalise = mode;
+	if(uri_rebase(uri, base))
+	{
+		uri_parse_discard_(dest, uri);
+		return NULL;
+	}
+	return uri;
+}
+
+/* Internal: resolve a reference which begins with a query or fragment
+ * against a hierarchical base, by duplicating the base (which shares its
+ * storage block) and replacing its query and fragment. If the reference
+ * can't be resolved this way (or would need to be normalised, and can't
+ * be), NULL is returned with errno set to zero.
+ */
+static URI *
+uri_parse_samedoc_(const char *str, size_t len, const URI *base, unsigned int mode)
+{
+	struct uri_scan_struct scan;
+	char *query, *fragment;
+	URI *uri;
+	int normal;
+
+	uri_lazy_(base, URI_LAZY_ALL_);
+	if(!base->absolute || !base->hier || uri_scan_(str, len, &scan))
+	{
+		errno = 0;
+		return NULL;
+	}
+	normal = base->normalised && uri_scan_normal_(&scan);
+	if(!normal && mode == URI_PARSE_NORMALISE_EAGER)
+	{
+		errno = 0;
+		return NULL;
+	}
+	uri = uri_dup_(base);
 	if(!uri)
 	{
 		return NULL;
 	}
-	/* Deal with non-hierarchical URIs properly:
-	 * Scan the string for the end of the scheme, If the character immediately
-	 * following the colon is not a slash, we consider the URI
-	 * non-hierarchical and parse it accordingly.
+	/* The base's query is retained unless the reference has its own, but
+	 * its fragment never is
 	 */
-	t = uri_schemeend_(str);
-	if(t && t[0] && t[1] != '/' && t[1] != '\\')
+	if(scan.query.first)
 	{
-		/* A scheme is present and the first character after the colon
-		 * is not slash
-		 */
-		uri->hier = 0;
-		if(uri_parse_nonhier_(uri, str))
+		query = uri_strndup_(uri, scan.query.first, scan.query.afterLast - scan.query.first);
+		if(!query)
 		{
 			uri_destroy(uri);
 			return NULL;
 		}
+		uri_free_(uri, uri->query);
+		uri->query = query;
+		uri->querylen = scan.query.afterLast - scan.query.first;
 	}
-	else
+	fragment = NULL;
+	if(scan.fragment.first)
 	{
-		uri->hier = 1;
-		state.uri = &(uri->uri);
-		if(uriParseUriA(&state, str) != URI_SUCCESS)
+		fragment = uri_strndup_(uri, scan.fragment.first, scan.fragment.afterLast - scan.fragment.first);
+		if(!fragment)
 		{
 			uri_destroy(uri);
 			return NULL;
 		}
 	}
-	if(uri_postparse_(uri))
+	uri_free_(uri, uri->fragment);
+	uri->fragment = fragment;
+	uri->fragmentlen = (fragment ? scan.fragment.afterLast - scan.fragment.first : 0);
+	uri->normalise = mode;
+	uri->normalised = normal;
+	return uri;
+}
+
+/* Internal: obtain the URI object which a parsed URI should be stored in:
+ * either dest, or if it is NULL, a new URI with storage bytes following it
+ */
+static URI *
+uri_parse_target_(URI *dest, size_t storage, struct uri_arena_struct *arena)
+{
+	if(dest)
+	{
+		return dest;
+	}
+	return uri_create_(storage, arena);
+}
+
+/* Internal: dispose of a URI obtained from uri_parse_target_() after a
+ * failure
+ */
+static void
+uri_parse_discard_(URI *dest, URI *uri)
+{
+	if(uri == dest)
+	{
+		uri_clear_(uri);
+	}
+	else
 	{
 		uri_destroy(uri);
+	}
+}
+
+/* Internal: create a URI from the components located by the structural
+ * scanner without involving uriparser; the caller must have checked that
+ * this is possible with uri_scan_simple_(), and uri_scan_normal_() if the
+ * URI must be normalised. If the URI has too many path segments, NULL is
+ * returned with errno set to zero.
+ */
+static URI *
+uri_parse_scanned_(URI *dest, const struct uri_scan_struct *scan, struct uri_arena_struct *arena)
+{
+	UriPathSegmentA segs[URI_SCAN_MAXSEGS_];
+	UriUriA parsed;
+	size_t nseg;
+	URI *uri;
+
+	if(uri_scan_split_(scan, &parsed, segs, &nseg))
+	{
 		return NULL;
 	}
-	if(uri_rebase(uri, base))
+	uri = uri_parse_target_(dest, uri_store_size_(&parsed), arena);
+	if(!uri)
 	{
-		uri_destroy(uri);
+		return NULL;
+	}
+	uri->hier = 1;
+	if(uri_store_(uri, &parsed))
+	{
+		uri_parse_discard_(dest, uri);
+		return NULL;
+	}
+	return uri;
+}
+
+/* Internal: populate dest with the components located by the structural
+ * scanner, splitting the path into segs (which must have room for
+ * URI_SCAN_MAXSEGS_ entries) and storing the number of segments in
+ * *nseg; dest refers to the scanned string rather than owning any of its
+ * components. If the path has too many segments, -1 is returned with
+ * errno set to zero.
+ */
+int
+uri_scan_split_(const struct uri_scan_struct *restrict scan, UriUriA *restrict dest, UriPathSegmentA *restrict segs, size_t *restrict nseg)
+{
+	const char *p, *end, *t;
+	size_t n;
+
+	memset(dest, 0, sizeof(UriUriA));
+	dest->scheme = scan->scheme;
+	dest->userInfo = scan->userinfo;
+	dest->hostText = scan->host;
+	dest->portText = scan->port;
+	dest->query = scan->query;
+	dest->fragment = scan->fragment;
+	*nseg = 0;
+	/* Split the path into segments in the same way that uriparser does: if
+	 * there's an authority, the path (if any) always begins with a slash,
+	 * and the segments follow it; otherwise, a leading slash sets the
+	 * absolute path flag.
+	 */
+	if(scan->path.first)
+	{
+		p = scan->path.first;
+		end = scan->path.afterLast;
+		if(*p == '/')
+		{
+			p++;
+			if(!scan->host.first)
+			{
+				dest->absolutePath = URI_TRUE;
+			}
+		}
+		if(p < end || scan->host.first)
+		{
+			for(n = 0; ; n++)
+			{
+				if(n == URI_SCAN_MAXSEGS_)
+				{
+					errno = 0;
+					return -1;
+				}
+				for(t = p; t < end && *t != '/'; t++);
+				memset(&(segs[n]), 0, sizeof(UriPathSegmentA));
+				segs[n].text.first = p;
+				segs[n].text.afterLast = t;
+				if(n)
+				{
+					segs[n - 1].next = &(segs[n]);
+				}
+				if(t >= end)
+				{
+					break;
+				}
+				p = t + 1;
+			}
+			dest->pathHead = &(segs[0]);
+			dest->pathTail = &(segs[n]);
+			*nseg = n + 1;
+		}
+	}
+	return 0;
+}
+
+/* Internal: determine whether the components located by the scanner
+ * contain nothing which requires uriparser's attention
+ */
+static int
+uri_scan_simple_(const struct uri_scan_struct *scan)
+{
+	const char *p;
+
+	/* IP literals need to be parsed into the host data */
+	if(scan->flags & URI_SCAN_IPLITERAL_)
+	{
+		return 0;
+	}
+	/* uriparser parses hosts which look like IPv4 addresses into the host
+	 * data
+	 */
+	if(!scan->host.first || scan->host.first == scan->host.afterLast)
+	{
+		return 1;
+	}
+	for(p = scan->host.first; p < scan->host.afterLast; p++)
+	{
+		if(*p != '.' && (*p < '0' || *p > '9'))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Internal: determine whether the components located by the scanner are
+ * already in the form which uriNormalizeSyntaxA() would produce, and
+ * contain nothing else which requires uriparser's attention
+ */
+int
+uri_scan_normal_(const struct uri_scan_struct *scan)
+{
+	const char *p, *seg;
+
+	if(!uri_scan_simple_(scan))
+	{
+		return 0;
+	}
+	/* Percent-encoded octets may need to be decoded or have their case
+	 * changed
+	 */
+	if(scan->flags & URI_SCAN_PCT_)
+	{
+		return 0;
+	}
+	/* An empty port is dropped by normalisation */
+	if(scan->port.first && scan->port.first == scan->port.afterLast)
+	{
+		return 0;
+	}
+	/* The scheme and host are normalised to lower-case */
+	for(p = scan->scheme.first; p && p < scan->scheme.afterLast; p++)
+	{
+		if(*p >= 'A' && *p <= 'Z')
+		{
+			return 0;
+		}
+	}
+	for(p = scan->host.first; p && p < scan->host.afterLast; p++)
+	{
+		if(*p >= 'A' && *p <= 'Z')
+		{
+			return 0;
+		}
+	}
+	/* Dot-segments are removed */
+	if(scan->path.first && memchr(scan->path.first, '.', scan->path.afterLast - scan->path.first))
+	{
+		for(seg = p = scan->path.first; p <= scan->path.afterLast; p++)
+		{
+			if(p == scan->path.afterLast || *p == '/')
+			{
+				if((p - seg == 1 && seg[0] == '.') ||
+				   (p - seg == 2 && seg[0] == '.' && seg[1] == '.'))
+				{
+					return 0;
+				}
+				seg = p + 1;
+			}
+		}
+	}
+	return 1;
+}
+
+/* Internal: create a URI by parsing str[0..len-1] with uriparser, and
+ * normalising it if normalise is nonzero
+ */
+static URI *
+uri_parse_uriparser_(URI *dest, const char *str, size_t len, int normalise, struct uri_arena_struct *arena)
+{
+	URI *uri;
+	UriParserStateA state;
+	UriUriA parsed;
+	const char *t;
+	
+	/* Deal with non-hierarchical URIs properly:
+	 * Scan the string for the end of the scheme, If the character immediately
+	 * following the colon is not a slash, we consider the URI
+	 * non-hierarchical. Those are parsed by uri_parse_nonhier_(), and so
+	 * reaching this point means that the scanner has rejected it.
+	 */
+	t = uri_schemeend_(str, len);
+	if(t && (t + 1 == str + len || (t[1] != '/' && t[1] != '\\')))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	else
+	{
+		memset(&parsed, 0, sizeof(UriUriA));
+		state.uri = &parsed;
+		if(uriParseUriExA(&state, str, str + len) != URI_SUCCESS)
+		{
+			uriFreeUriMembersA(&parsed);
+			return NULL;
+		}
+		if(normalise)
+		{
+			uriNormalizeSyntaxA(&parsed);
+		}
+		/* Allocate the URI object with enough space following it to hold
+		 * all of the components, so that the whole URI is a single heap
+		 * block
+		 */
+		uri = uri_parse_target_(dest, uri_store_size_(&parsed), arena);
+		if(!uri)
+		{
+			uriFreeUriMembersA(&parsed);
+			return NULL;
+		}
+		uri->hier = 1;
+		uri->normalised = normalise;
+	}
+	if(uri_postparse_(uri, &parsed))
+	{
+		uri_parse_discard_(dest, uri);
 		return NULL;
 	}
 	return uri;
 }
 
-/* Internal: find the first character after the URI scheme; this function will
- * therefore return either NULL, or a pointer to a colon.
+/* Internal: find the first character after the URI scheme within
+ * str[0..len-1]; this function will therefore return either NULL, or a
+ * pointer to a colon.
  */
 static const char *
-uri_schemeend_(const char *str)
+uri_schemeend_(const char *str, size_t len)
 {
-	for(; str && *str; str++)
+	const char *end;
+
+	for(end = str + len; str < end && *str; str++)
 	{
 		if(*str == ':')
 		{
@@ -113,242 +645,373 @@ uri_schemeend_(const char *str)
 	return NULL;
 }
 
-/* Internal: parse a non-hierarchical URI
- * This is a URI in the form:
+/* Internal: create a non-hierarchical URI from the components located by
+ * the structural scanner. This is a URI in the form:
  *
- * scheme ':' authority ':' namespace-specific + '?' query + '#' + fragment
+ * scheme ':' namespace-specific + '?' query + '#' + fragment
  *
- * The namespace-specific segment (NSS) is considered to be an opaque string.
-*/
-static int
-uri_parse_nonhier_(URI *restrict dest, const char *uristr)
+ * The namespace-specific string (NSS) is considered to be an opaque string,
+ * and is stored as the sole segment of the path so that uriparser can
+ * recompose and compare the URI; uri->nss points to the segment's text,
+ * within the storage block.
+ */
+static URI *
+uri_parse_nonhier_(URI *dest, const struct uri_scan_struct *scan, int normalise, struct uri_arena_struct *arena)
 {
-#warning Handling non-hierarchical URIs is not yet supported
-	errno = EPERM;
-	return -1;
-}
+	UriUriA parsed;
+	UriPathSegmentA seg;
+	URI *uri;
+	const char *p;
 
-/* Internal: perform post-parsing normalisation and manipulation of a URI */
-int
-uri_postparse_(URI *uri)
-{
-	uriNormalizeSyntaxA(&(uri->uri));
-	/* Copy the UriUriA text ranges into new buffers, then set the
-	 * ranges to point back to our new buffers. This means that the uriparser
-	 * APIs will still work on our UriUriA object, but we can manipulate the
-	 * components as needed.
-	 *
-	 * The UriUriA's owner flag will be set to false, indicating that with the
-	 * exception of the ip4 and ip6 structs within its hostData, it does not
-	 * own any of the memory its text ranges point at.
+	memset(&parsed, 0, sizeof(UriUriA));
+	memset(&seg, 0, sizeof(UriPathSegmentA));
+	parsed.scheme = scan->scheme;
+	parsed.query = scan->query;
+	parsed.fragment = scan->fragment;
+	/* An empty NSS is stored as an empty segment */
+	seg.text = scan->path;
+	if(!seg.text.first)
+	{
+		seg.text.first = seg.text.afterLast = scan->scheme.afterLast + 1;
+	}
+	/* The payload of a data: URI extends to the fragment, and so includes
+	 * anything which looks like a query
 	 */
-	uri->scheme = uri_range_copy_(&(uri->uri.scheme));
-	if(uri->scheme)
+	if(scan->query.first && scan->scheme.afterLast - scan->scheme.first == 4 &&
+	   (scan->scheme.first[0] | 0x20) == 'd' && (scan->scheme.first[1] | 0x20) == 'a' &&
+	   (scan->scheme.first[2] | 0x20) == 't' && (scan->scheme.first[3] | 0x20) == 'a')
 	{
-		uri->absolute = 1;
+		seg.text.afterLast = scan->query.afterLast;
+		parsed.query.first = parsed.query.afterLast = NULL;
 	}
-	uri->auth = uri_range_copy_(&(uri->uri.userInfo));
-	uri->hoststr = uri_range_copy_(&(uri->uri.hostText));
-	uri->portstr = uri_range_copy_(&(uri->uri.portText));
-	uri->query = uri_range_copy_(&(uri->uri.query));
-	uri->fragment = uri_range_copy_(&(uri->uri.fragment));
-	/* Copy the path data */
-	if(uri_path_copy_(uri, uri->uri.pathHead))
+	parsed.pathHead = parsed.pathTail = &seg;
+	uri = uri_parse_target_(dest, uri_store_size_(&parsed), arena);
+	if(!uri)
 	{
-		return -1;
+		return NULL;
 	}
-	/* Copy the host data */
-	if((uri->hostdata.ipFuture.first = uri_range_copy_(&(uri->uri.hostData.ipFuture))))
+	uri->hier = 0;
+	if(uri_store_(uri, &parsed))
 	{
-		uri->hostdata.ipFuture.afterLast = strchr(uri->hostdata.ipFuture.first, 0);
+		uri_parse_discard_(dest, uri);
+		return NULL;
 	}
-	if(uri_hostdata_copy_(&(uri->hostdata), &(uri->uri.hostData)))
+	uri->nss = (char *) uri->pathfirst->text.first;
+	if(normalise)
 	{
-		return -1;
+		uri_normalise_nonhier_(uri);
 	}
-	/* Parse the port number, if present */
-	if(uri->portstr)
+	else
 	{
-		uri->port = atoi(uri->portstr);
-		if(uri->port < 1 || uri->port > 65535)
+		uri->normalised = 1;
+		for(p = uri->scheme; *p; p++)
 		{
-			uri->port = 0;
+			if(*p >= 'A' && *p <= 'Z')
+			{
+				uri->normalised = 0;
+				break;
+			}
 		}
 	}
-	return uri_postparse_set_(uri);
+	return uri;
 }
 
-/* Replace the members of a UriUriA with pointers to our own buffers
- * excepting ip4 and ip6 within the hostData member, which is always
- * duplicated.
+/* Internal: normalise a non-hierarchical URI; because the NSS is opaque,
+ * only the scheme is affected
  */
-int
-uri_postparse_set_(URI *uri)
+static int
+uri_normalise_nonhier_(URI *uri)
 {
-	uriFreeUriMembersA(&(uri->uri));
-	uri->uri.owner = URI_FALSE;
-	uri_range_set_(&(uri->uri.scheme), uri->scheme);
-	uri_range_set_(&(uri->uri.userInfo), uri->auth);
-	uri_range_set_(&(uri->uri.hostText), uri->hoststr);
-	uri_range_set_(&(uri->uri.portText), uri->portstr);
-	uri_range_set_(&(uri->uri.query), uri->query);
-	uri_range_set_(&(uri->uri.fragment), uri->fragment);
-	uri_range_set_(&(uri->uri.hostData.ipFuture), uri->hostdata.ipFuture.first);
-	uri_hostdata_copy_(&(uri->uri.hostData), &(uri->hostdata));
-	uri_path_copy_ref_(&(uri->uri.pathHead), &(uri->uri.pathTail), uri->pathfirst);
-	uri->uri.absolutePath = (uri->pathabs ? URI_TRUE : URI_FALSE);
-	return 0;
-}
+	char *p;
 
-/* Internal: copy a UriHostData struct, allocating memory as needed */
-int
-uri_hostdata_copy_(struct UriHostDataStructA *restrict dest, const struct UriHostDataStructA *restrict src)
-{	
-	if(src->ip4)
+	/* A scheme held in a storage block which is shared with other URIs
+	 * must be copied before it can be modified
+	 */
+	if(uri->scheme && uri_shared_(uri) && uri->scheme >= uri->block && uri->scheme < uri->block + uri->blocksize)
 	{
-		dest->ip4 = (UriIp4 *) calloc(1, sizeof(UriIp4));
-		if(!dest->ip4)
+		p = uri_strdup_inline_(uri, uri->scheme, uri->schemebuf, sizeof(uri->schemebuf));
+		if(!p)
 		{
 			return -1;
 		}
-		memcpy(dest->ip4, src->ip4, sizeof(UriIp4));
+		uri->scheme = p;
 	}
-	if(src->ip6)
+	for(p = uri->scheme; p && *p; p++)
 	{
-		dest->ip6 = (UriIp6 *) calloc(1, sizeof(UriIp6));
-		if(!dest->ip6)
+		if(*p >= 'A' && *p <= 'Z')
 		{
-			return -1;
+			*p += 'a' - 'A';
 		}
-		memcpy(dest->ip6, src->ip6, sizeof(UriIp6));
 	}
+	uri->normalised = 1;
 	return 0;
 }
 
-/* Internal: copy a UriPath into our URI object */
+/* Internal: perform post-parsing manipulation of a URI: the components of
+ * parsed, the output of the parser (which should already have been
+ * normalised), are copied into the URI's own storage block, and the
+ * parser's data is freed
+ */
 int
-uri_path_copy_(URI *uri, const UriPathSegmentA *head)
+uri_postparse_(URI *restrict uri, UriUriA *restrict parsed)
 {
-	UriPathSegmentA *seg, *prev;
+	int r;
 
-	prev = NULL;
-	uri->pathabs = (int) uri->uri.absolutePath;
-	for(; head; head = head->next)
+	r = uri_store_(uri, parsed);
+	uriFreeUriMembersA(parsed);
+	return r;
+}
+
+/* Internal: fill in a uriparser UriUriA which refers to the components of
+ * the URI, for those operations which are delegated to uriparser. The
+ * result never owns any memory of its own, and so uriFreeUriMembersA()
+ * must not be invoked on it; it remains valid until the URI is modified.
+ */
+void
+uri_mirror_(const URI *restrict uri, UriUriA *restrict dest)
+{
+	uri_lazy_(uri, URI_LAZY_ALL_);
+	memset(dest, 0, sizeof(UriUriA));
+	dest->owner = URI_FALSE;
+	uri_range_set_(&(dest->scheme), uri->scheme, uri->schemelen);
+	uri_range_set_(&(dest->userInfo), uri->auth, uri->authlen);
+	uri_range_set_(&(dest->hostText), uri->hoststr, uri->hostlen);
+	uri_range_set_(&(dest->portText), uri->portstr, uri->portlen);
+	uri_range_set_(&(dest->query), uri->query, uri->querylen);
+	uri_range_set_(&(dest->fragment), uri->fragment, uri->fragmentlen);
+	dest->hostData.ipFuture = uri->hostdata.ipFuture;
+	dest->hostData.ip4 = uri->hostdata.ip4;
+	dest->hostData.ip6 = uri->hostdata.ip6;
+	dest->pathHead = uri->pathfirst;
+	dest->pathTail = uri->pathlast;
+	dest->absolutePath = (uri->pathabs ? URI_TRUE : URI_FALSE);
+}
+
+/* Internal: if the host of src is an IP literal, write the text which
+ * uriparser recomposes it as, null-terminated, to buf (if not NULL) and
+ * return the space needed to do so; otherwise, return zero. The space
+ * includes two bytes more than the text itself, because uriparser writes
+ * the host preceded by '//'.
+ */
+static size_t
+uri_store_hostlit_(const UriUriA *src, char *buf)
+{
+	UriUriA host;
+	size_t size;
+
+	if(!src->hostText.first || (!src->hostData.ip4 && !src->hostData.ip6 && !src->hostData.ipFuture.first))
+	{
+		return 0;
+	}
+	memset(&host, 0, sizeof(UriUriA));
+	host.hostText = src->hostText;
+	host.hostData = src->hostData;
+	/* The recomposed form is the host preceded by '//' */
+	size = uri_recompose_(&host, NULL, 0);
+	if(size == (size_t) -1 || size < 3)
+	{
+		return 0;
+	}
+	if(buf)
+	{
+		uri_recompose_(&host, buf, size);
+		memmove(buf, buf + 2, size - 2);
+	}
+	return size;
+}
+
+/* Internal: determine the size of the storage block needed to hold all of
+ * the components of src
+ */
+size_t
+uri_store_size_(const UriUriA *src)
+{
+	const UriPathSegmentA *seg;
+	size_t size;
+
+	size = 0;
+	for(seg = src->pathHead; seg; seg = seg->next)
+	{
+		size += sizeof(UriPathSegmentA) + uri_range_size_(&(seg->text));
+	}
+	if(src->hostData.ip4)
 	{
-		seg = (UriPathSegmentA *) calloc(1, sizeof(UriPathSegmentA));
-		if(!seg)
+		size += sizeof(UriIp4);
+	}
+	if(src->hostData.ip6)
+	{
+		size += sizeof(UriIp6);
+	}
+	size += uri_range_size_(&(src->scheme));
+	size += uri_range_size_(&(src->userInfo));
+	size += uri_range_size_(&(src->hostText));
+	size += uri_range_size_(&(src->hostData.ipFuture));
+	size += uri_store_hostlit_(src, NULL);
+	size += uri_range_size_(&(src->portText));
+	size += uri_range_size_(&(src->query));
+	size += uri_range_size_(&(src->fragment));
+	return size;
+}
+
+/* Internal: copy the components of src into the URI's storage block,
+ * allocating one if the URI doesn't already have a large enough block
+ * available. The path segments are laid out as an array at the start of the
+ * block (so that they are suitably aligned), followed by the host data and
+ * then the null-terminated component strings.
+ */
+int
+uri_store_(URI *uri, const UriUriA *src)
+{
+	const UriPathSegmentA *seg;
+	UriPathSegmentA *dseg, *prev;
+	size_t size, len;
+	char *p;
+
+	size = uri_store_size_(src);
+	if(size > uri->blocksize)
+	{
+		if(uri->arena)
+		{
+			p = (char *) uri_arena_alloc_(uri->arena, size);
+		}
+		else
+		{
+			p = (char *) uri_mem_alloc_(size);
+		}
+		if(!p)
 		{
 			return -1;
 		}
-		seg->text.first = uri_range_copy_(&(head->text));
-		if(seg->text.first)
+		if(!uri->arena && uri->block != (char *) (uri + 1))
 		{
-			seg->text.afterLast = strchr(seg->text.first, 0);
+			uri_mem_free_(uri->block);
 		}
+		uri->block = p;
+		uri->blocksize = size;
+	}
+	p = uri->block;
+	/* Path segments, linked in order */
+	prev = NULL;
+	uri->pathcount = 0;
+	for(seg = src->pathHead; seg; seg = seg->next)
+	{
+		dseg = (UriPathSegmentA *) p;
+		p += sizeof(UriPathSegmentA);
+		memset(dseg, 0, sizeof(UriPathSegmentA));
 		if(prev)
 		{
-			prev->next = seg;
+			prev->next = dseg;
 		}
 		else
 		{
-			uri->pathfirst = seg;
+			uri->pathfirst = dseg;
 		}
-		prev = seg;
+		prev = dseg;
+		uri->pathcount++;
 	}
 	uri->pathlast = prev;
 	uri->pathcur = uri->pathfirst;
-	return 0;
-}
-
-/* Internal: create a new chain of path segments referencing the
- * strings in the source segment; this is used because even if
- * UriUriA::owner is false, the segments themselves will still be
- * freed by uriFreeUriMembersA().
- */
-static int
-uri_path_copy_ref_(UriPathSegmentA **head, UriPathSegmentA **tail, const UriPathSegmentA *src)
-{
-	UriPathSegmentA *seg, *prev;
-
-	prev = NULL;
-	for(; src; src = src->next)
+	uri->pathabs = (int) src->absolutePath;
+	/* Host data */
+	if(src->hostData.ip4)
 	{
-		seg = (UriPathSegmentA *) calloc(1, sizeof(UriPathSegmentA));
-		if(!seg)
-		{
-			return -1;
-		}
-		seg->text.first = src->text.first;
-		seg->text.afterLast = src->text.afterLast;
-		if(prev)
+		uri->hostdata.ip4 = (UriIp4 *) p;
+		memcpy(p, src->hostData.ip4, sizeof(UriIp4));
+		p += sizeof(UriIp4);
+	}
+	if(src->hostData.ip6)
+	{
+		uri->hostdata.ip6 = (UriIp6 *) p;
+		memcpy(p, src->hostData.ip6, sizeof(UriIp6));
+		p += sizeof(UriIp6);
+	}
+	/* Component strings */
+	uri->scheme = uri_range_store_(&p, &(src->scheme), &(uri->schemelen));
+	if(uri->scheme)
+	{
+		uri->absolute = 1;
+	}
+	uri->auth = uri_range_store_(&p, &(src->userInfo), &(uri->authlen));
+	uri->hoststr = uri_range_store_(&p, &(src->hostText), &(uri->hostlen));
+	if((uri->hostdata.ipFuture.first = uri_range_store_(&p, &(src->hostData.ipFuture), &len)))
+	{
+		uri->hostdata.ipFuture.afterLast = uri->hostdata.ipFuture.first + len;
+	}
+	if((len = uri_store_hostlit_(src, p)))
+	{
+		uri->hostlit = p;
+		uri->hostlitlen = len - 3;
+		p += len - 2;
+	}
+	uri->portstr = uri_range_store_(&p, &(src->portText), &(uri->portlen));
+	uri->query = uri_range_store_(&p, &(src->query), &(uri->querylen));
+	uri->fragment = uri_range_store_(&p, &(src->fragment), &(uri->fragmentlen));
+	uri->pathlen = 0;
+	for(seg = src->pathHead, dseg = uri->pathfirst; seg; seg = seg->next, dseg = dseg->next)
+	{
+		if((dseg->text.first = uri_range_store_(&p, &(seg->text), &len)))
 		{
-			prev->next = seg;
+			dseg->text.afterLast = dseg->text.first + len;
 		}
-		else
+		uri->pathlen += len + (dseg != uri->pathfirst);
+	}
+	/* Parse the port number, if present */
+	if(uri->portstr)
+	{
+		uri->port = atoi(uri->portstr);
+		if(uri->port < 1 || uri->port > 65535)
 		{
-			*head = seg;
+			uri->port = 0;
 		}
-		prev = seg;
 	}
-	*tail = prev;
 	return 0;
 }
 
-/* Internal: copy a UriTextRange to a newly-allocated buffer */
-static char *
-uri_range_copy_(const UriTextRangeA *range)
+/* Internal: return the number of bytes needed to store a UriTextRange as a
+ * null-terminated string, or zero if the range is absent
+ */
+static size_t
+uri_range_size_(const UriTextRangeA *range)
 {
-	size_t l;
-	char *buf;
-	
-	if(range->first && range->afterLast)
+	if(!range->first)
 	{
-		l = range->afterLast - range->first + 1;
+		return 0;
 	}
-	else if(range->first)
-	{
-		l = strlen(range->first) + 1;
-	}
-	else
+	if(range->afterLast)
 	{
-		errno = 0;
-		return NULL;
+		return range->afterLast - range->first + 1;
 	}
+	return strlen(range->first) + 1;
+}
+
+/* Internal: copy a UriTextRange to the storage block at *p as a
+ * null-terminated string, advancing *p past it
+ */
+static char *
+uri_range_store_(char *restrict *restrict p, const UriTextRangeA *restrict range, size_t *restrict len)
+{
+	size_t l;
+	char *buf;
+	
+	l = uri_range_size_(range);
+	*len = (l ? l - 1 : 0);
 	if(!l)
 	{
-		errno = 0;
 		return NULL;
 	}
-	buf = (char *) malloc(l);
-	if(!buf)
-	{
-		return NULL;
-	}
-	strncpy(buf, range->first, l);
+	buf = *p;
+	memcpy(buf, range->first, l - 1);
 	buf[l - 1] = 0;
+	*p += l;
 	return buf;
 }
 
-/* Internal: free a UriTextRange if it's owned by the UriUri, and then
- * set it to point to the supplied null-terminated string. Note that
- * uri->owner must be set to URI_FALSE after calling this or else
- * uriFreeUriMembersA() will free heap blocks it doesn't own.
- * src may be NULL. owner must be uri->owner.
+/* Internal: set a range to refer to the len characters of src (or to
+ * nothing, if src is NULL)
  */
-static int
-uri_range_set_(UriTextRangeA *range, const char *src)
+static void
+uri_range_set_(UriTextRangeA *restrict range, const char *restrict src, size_t len)
 {
-	/* Set the range to point to the entire length of src (provided src
-	 * is non-NULL)
-	 */
 	range->first = src;
-	if(src)
-	{
-		range->afterLast = strchr(src, 0);
-	}
-	else
-	{
-		range->afterLast = NULL;
-	}
-	return 0;
+	range->afterLast = (src ? src + len : NULL);
 }
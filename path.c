@@ -33,10 +33,10 @@ size_t
 uri_path(const URI *restrict uri, char *restrict buf, size_t buflen)
 {
 	size_t total, len;
-	char *bp;
-	UriPathSegmentA *p;
+	const UriPathSegmentA *p;
 	
-	if(!uri->uri.pathHead && !uri->uri.absolutePath)
+	uri_lazy_(uri, URI_LAZY_PATH_ | URI_LAZY_HOST_);
+	if(!uri->pathfirst && !uri->pathabs)
 	{
 		if(buf && buflen)
 		{
@@ -44,54 +44,39 @@ uri_path(const URI *restrict uri, char *restrict buf, size_t buflen)
 		}
 		return 0;
 	}
-	total = 0;
-	bp = buf;
-	if(uri_absolute_path(uri))
+	/* The length of the path is known in advance, so only the segments
+	 * which will fit need to be visited
+	 */
+	total = uri->pathlen;
+	/* The opaque path of a non-hierarchical URI never has a leading slash */
+	if(uri->hier && uri_absolute_path(uri))
 	{
 		uri_addch_('/', &buf, &buflen);
 		total++;
 	}
-	if(buf && buflen)
+	if(!buf || !buflen)
 	{
-		*buf = 0;
+		return total + 1;
 	}
-	for(p = uri->pathfirst; p; p = p->next)
+	for(p = uri->pathfirst; p && buflen > 1; p = p->next)
 	{
 		if(p != uri->pathfirst)
 		{
 			uri_addch_('/', &buf, &buflen);
-			total++;
 		}
-		if(!p->text.first)
+		len = p->text.afterLast - p->text.first;
+		if(len >= buflen)
 		{
-			return (size_t) -1;
+			len = buflen - 1;
 		}
-		if(!p->text.first[0])
+		if(len)
 		{
-			continue;
-		}
-		len = strlen(p->text.first) + 1;
-		if(buf)
-		{
-			strncpy(buf, p->text.first, buflen - 1);
-			buf[buflen - 1] = 0;
-		}
-		len--;
-		total += len;
-		if(buflen < len)
-		{
-			buflen = 0;
-			buf = NULL;
-		}
-		else
-		{
-			if(buf)
-			{
-				buf += len;
-			}
-			buflen -= len;
+			memcpy(buf, p->text.first, len);
 		}
+		buf += len;
+		buflen -= len;
 	}
+	*buf = 0;
 	return total + 1;
 }
 
@@ -99,14 +84,111 @@ uri_path(const URI *restrict uri, char *restrict buf, size_t buflen)
 int
 uri_absolute_path(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_HOST_);
 	return uri->pathabs || (uri->absolute && !uri->hier) || uri->hoststr;
 }
 
+/* Return the number of segments in the URI's path. A trailing slash
+ * results in a final empty segment, as does the path of 'http://host/'
+ */
+size_t
+uri_path_segments_count(const URI *uri)
+{
+	uri_lazy_(uri, URI_LAZY_PATH_);
+	return uri->pathcount;
+}
+
+/* Copy segment number index of the URI's path into the buffer provided,
+ * returning the buffer size needed, or 0 if there is no such segment
+ */
+size_t
+uri_path_segment(const URI *restrict uri, size_t index, char *restrict buf, size_t buflen)
+{
+	const char *str;
+	size_t len;
+
+	str = uri_path_segment_view(uri, index, &len);
+	return uri_copy_(str, len, buf, buflen);
+}
+
+/* Return segment number index of the URI's path as a const string pointer,
+ * or NULL if there is no such segment
+ */
+const char *
+uri_path_segment_str(const URI *uri, size_t index)
+{
+	uri_lazy_(uri, URI_LAZY_PATH_);
+	if(index >= uri->pathcount)
+	{
+		errno = 0;
+		return NULL;
+	}
+	return uri->pathfirst[index].text.first;
+}
+
+/* Return segment number index of the URI's path as a pointer and length,
+ * without rescanning it, or NULL if there is no such segment
+ */
+const char *
+uri_path_segment_view(const URI *restrict uri, size_t index, size_t *restrict len)
+{
+	uri_lazy_(uri, URI_LAZY_PATH_);
+	if(index >= uri->pathcount)
+	{
+		*len = 0;
+		errno = 0;
+		return NULL;
+	}
+	*len = uri->pathfirst[index].text.afterLast - uri->pathfirst[index].text.first;
+	return uri->pathfirst[index].text.first;
+}
+
+/* Return the path segment at the URI's cursor without moving it, or NULL
+ * if all of the segments have been consumed
+ */
+const char *
+uri_peek(const URI *uri)
+{
+	uri_lazy_(uri, URI_LAZY_PATH_);
+	if(!uri->pathcur)
+	{
+		return NULL;
+	}
+	return uri->pathcur->text.first;
+}
+
+/* Return the path segment at the URI's cursor and advance the cursor to
+ * the next one, or return NULL if all of the segments have been consumed
+ */
+const char *
+uri_consume(URI *uri)
+{
+	const char *str;
+
+	uri_lazy_(uri, URI_LAZY_PATH_);
+	if(!uri->pathcur)
+	{
+		return NULL;
+	}
+	str = uri->pathcur->text.first;
+	uri->pathcur = uri->pathcur->next;
+	return str;
+}
+
+/* Move the URI's cursor back to the first path segment */
+int
+uri_rewind(URI *uri)
+{
+	uri_lazy_(uri, URI_LAZY_PATH_);
+	uri->pathcur = uri->pathfirst;
+	return 0;
+}
+
 /* Add a single character to buf, provided it has space */
 static int
 uri_addch_(int ch, char *restrict *restrict buf, size_t *restrict buflen)
 {
-	if(*buf && *buflen)
+	if(*buf && *buflen > 1)
 	{
 		**buf = ch;
 		(*buf)++;
@@ -30,26 +30,24 @@
 size_t
 uri_port(const URI *restrict uri, char *restrict buf, size_t buflen)
 {
-	if(!uri->portstr)
-	{
-		if(buf && buflen)
-		{
-			*buf = 0;
-		}
-		return 0;
-	}
-	if(buf && buflen)
-	{
-		strncpy(buf, uri->portstr, buflen - 1);
-		buf[buflen - 1] = 0;
-	}
-	return strlen(uri->portstr) + 1;
+	uri_lazy_(uri, URI_LAZY_PORT_);
+	return uri_copy_(uri->portstr, uri->portlen, buf, buflen);
 }
 
 /* Return the port as const string pointer */
 const char *
 uri_port_str(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_PORT_);
+	return uri->portstr;
+}
+
+/* Return the port as a pointer and length, without rescanning it */
+const char *
+uri_port_view(const URI *restrict uri, size_t *restrict len)
+{
+	uri_lazy_(uri, URI_LAZY_PORT_);
+	*len = uri->portlen;
 	return uri->portstr;
 }
 
@@ -59,6 +57,7 @@ uri_port_str(const URI *uri)
 char *
 uri_port_stralloc(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_PORT_);
 	if(!uri->portstr)
 	{
 		errno = 0;
@@ -78,38 +77,39 @@ uri_portnum(const URI *uri)
 int
 uri_set_port(URI *restrict uri, int newport)
 {
-	char portbuf[16];
 	char *sbuf;
+	int n;
 
+	uri_lazy_(uri, URI_LAZY_PORT_);
 	if(newport < 0 || newport > 65535)
 	{
 		errno = EINVAL;
 		return -1;
 	}
+	uri_recomposed_dirty_(uri, URI_COMPOSED_AUTHORITY_);
+	uri_free_(uri, uri->portstr);
 	if(newport)
 	{
-		snprintf(portbuf, sizeof(portbuf), "%d", newport);
-		sbuf = strdup(portbuf);
-		if(!sbuf)
+		/* A port number always fits within the inline buffer, and so can
+		 * be formatted directly into it
+		 */
+		sbuf = uri->portbuf + sizeof(uri->portbuf) - 1;
+		*sbuf = 0;
+		for(n = newport; n; n /= 10)
 		{
-			return -1;
+			sbuf--;
+			*sbuf = '0' + (n % 10);
 		}
+		uri->portlen = uri->portbuf + sizeof(uri->portbuf) - 1 - sbuf;
+		memmove(uri->portbuf, sbuf, uri->portlen + 1);
+		sbuf = uri->portbuf;
 	}
 	else
 	{
 		sbuf = NULL;
+		uri->portlen = 0;
 	}
-	free(uri->portstr);
 	uri->portstr = sbuf;
-	uri->uri.portText.first = sbuf;
-	if(sbuf)
-	{
-		uri->uri.portText.afterLast = strchr(sbuf, 0);
-	}
-	else
-	{
-		uri->uri.portText.afterLast = NULL;
-	}
 	uri->port = (unsigned int) newport;
 	return 0;
 }
@@ -30,26 +30,24 @@
 size_t
 uri_query(const URI *restrict uri, char *restrict buf, size_t buflen)
 {
-	if(!uri->query)
-	{
-		if(buf && buflen)
-		{
-			*buf = 0;
-		}
-		return 0;
-	}
-	if(buf && buflen)
-	{
-		strncpy(buf, uri->query, buflen - 1);
-		buf[buflen - 1] = 0;
-	}
-	return strlen(uri->query) + 1;
+	uri_lazy_(uri, URI_LAZY_QUERY_);
+	return uri_copy_(uri->query, uri->querylen, buf, buflen);
 }
 
 /* Return the query as const string pointer */
 const char *
 uri_query_str(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_QUERY_);
+	return uri->query;
+}
+
+/* Return the query as a pointer and length, without rescanning it */
+const char *
+uri_query_view(const URI *restrict uri, size_t *restrict len)
+{
+	uri_lazy_(uri, URI_LAZY_QUERY_);
+	*len = uri->querylen;
 	return uri->query;
 }
 
@@ -59,6 +57,7 @@ uri_query_str(const URI *uri)
 char *
 uri_query_stralloc(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_QUERY_);
 	if(!uri->query)
 	{
 		errno = 0;
@@ -73,26 +72,20 @@ uri_set_query(URI *restrict uri, const char *restrict newquery)
 {
 	char *sbuf;
 
+	uri_lazy_(uri, URI_LAZY_QUERY_);
 	sbuf = NULL;
 	if(newquery)
 	{
-		sbuf = strdup(newquery);
+		sbuf = uri_strdup_(uri, newquery);
 		if(!sbuf)
 		{
 			return -1;
 		}
 		newquery = sbuf;
 	}
-	free(uri->query);
+	uri_recomposed_dirty_(uri, URI_COMPOSED_QUERY_);
+	uri_free_(uri, uri->query);
 	uri->query = sbuf;
-	uri->uri.query.first = sbuf;
-	if(sbuf)
-	{
-		uri->uri.query.afterLast = strchr(sbuf, 0);
-	}
-	else
-	{
-		uri->uri.query.afterLast = NULL;
-	}
+	uri->querylen = (sbuf ? strlen(sbuf) : 0);
 	return 0;
 }
@@ -26,17 +26,25 @@
 #include "p_liburi.h"
 
 static int uri_rebase_nonhier_(URI *restrict reluri, const URI *restrict base);
+static size_t uri_rebase_dots_(UriPathSegmentA *segs, size_t count);
 
 /* Rebase reluri against the given base. If reluri is already absolute,
  * or base is NULL, this is a no-op. This function will modifiy reluri;
  * if this is not desirable, duplicate it first with uri_create_uri().
+ *
+ * The target URI is assembled directly from the components of the base
+ * and the reference, as described by RFC 3986 section 5.2.2, with the path
+ * merged and its dot-segments removed segment-by-segment; the result is
+ * then copied into a single new storage block.
  */
 int
 uri_rebase(URI *restrict reluri, const URI *restrict base)
 {
 	URI abstemp;
+	UriUriA target, relmirror, basemirror;
+	UriPathSegmentA segbuf[URI_REBASE_SEGS_], *segs;
+	int r;
 
-	memset(&abstemp, 0, sizeof(URI));	
 	if(!base || reluri->absolute)
 	{
 		/* Either no base provided (no-op), or reluri is already
@@ -44,6 +52,8 @@ uri_rebase(URI *restrict reluri, const URI *restrict base)
 		 */
 		return 0;
 	}
+	uri_lazy_(reluri, URI_LAZY_ALL_);
+	uri_lazy_(base, URI_LAZY_ALL_);
 	if(!base->hier)
 	{
 		/* The base URI is non-hierarchical, which means we need to
@@ -53,31 +63,217 @@ uri_rebase(URI *restrict reluri, const URI *restrict base)
 		 */
 		return uri_rebase_nonhier_(reluri, base);
 	}
-	if(uriAddBaseUriA(&(abstemp.uri), &(reluri->uri), &(base->uri)) != URI_SUCCESS)
+	if(!base->absolute)
 	{
-		/* Rebasing failed */
+		/* A reference can only be resolved against an absolute URI */
+		errno = EINVAL;
 		return -1;
 	}
-	if(uriEqualsUriA(&(abstemp.uri), &(reluri->uri)) == URI_TRUE)
+	uri_mirror_(reluri, &relmirror);
+	uri_mirror_(base, &basemirror);
+	if(uri_resolve_(&target, &relmirror, reluri->pathcount, &basemirror, base->pathcount, segbuf, &segs))
 	{
-		/* Rebasing didn't result in a new URI */
-		uriFreeUriMembersA(&(abstemp.uri));
-		return 0;
+		return -1;
+	}
+	memset(&abstemp, 0, sizeof(URI));
+	/* Allocate the new storage block from the same place as reluri */
+	abstemp.arena = reluri->arena;
+	r = uri_store_(&abstemp, &target);
+	if(segs && segs != segbuf)
+	{
+		uri_mem_free_(segs);
+	}
+	if(r)
+	{
+		uri_reset_(&abstemp);
+		return -1;
 	}
-	uri_postparse_(&abstemp);
+	abstemp.hier = 1;
+	/* Merging components which are each in normal form, and removing the
+	 * dot-segments from the result, yields a URI in normal form
+	 */
+	abstemp.normalise = reluri->normalise;
+	abstemp.normalised = reluri->normalised && base->normalised;
 	/* Free the resources used by reluri, replace its contents with that
 	 * from absolute.
 	 */
 	uri_reset_(reluri);
-	memcpy(reluri, &abstemp, sizeof(URI));
+	uri_move_(reluri, &abstemp);
+	/* The result is normalised only if reluri would have been */
+	if(reluri->normalise == URI_PARSE_NORMALISE_EAGER && !reluri->normalised)
+	{
+		return uri_normalise(reluri);
+	}
+	return 0;
+}
+
+/* Internal: assemble the target URI of resolving the reference ref, which
+ * has refcount path segments, against the absolute hierarchical URI base,
+ * which has basecount, as described by RFC 3986 section 5.2.2. The path
+ * segments of each must be contiguous, as they are in a storage block.
+ * If the path needs to be merged, the result is placed in segbuf (which
+ * has room for URI_REBASE_SEGS_ entries) if it fits, or a new array
+ * otherwise; *segs is set to whichever is used, or NULL if neither is,
+ * and if it is not segbuf it must be freed by the caller once target is
+ * no longer needed. The components of target refer to those of ref and
+ * base rather than being copied.
+ */
+int
+uri_resolve_(UriUriA *restrict target, const UriUriA *ref, size_t refcount, const UriUriA *base, size_t basecount, UriPathSegmentA *segbuf, UriPathSegmentA **segs)
+{
+	const UriUriA *authority;
+	size_t count, nbase, c;
+
+	memset(target, 0, sizeof(UriUriA));
+	target->scheme = base->scheme;
+	authority = (ref->hostText.first ? ref : base);
+	target->userInfo = authority->userInfo;
+	target->hostText = authority->hostText;
+	target->hostData = authority->hostData;
+	target->portText = authority->portText;
+	target->query = ref->query;
+	target->fragment = ref->fragment;
+	*segs = NULL;
+	if(!ref->hostText.first && !ref->pathHead && !ref->absolutePath)
+	{
+		/* The reference has an empty path, so the base path is used as-is,
+		 * along with the base query unless the reference has its own
+		 */
+		target->pathHead = base->pathHead;
+		target->pathTail = base->pathTail;
+		target->absolutePath = base->absolutePath;
+		if(!ref->query.first)
+		{
+			target->query = base->query;
+		}
+		return 0;
+	}
+	/* Unless the reference's path is absolute (or it has an authority), it
+	 * is merged with all but the last segment of the base path
+	 */
+	nbase = 0;
+	if(!ref->hostText.first && !ref->absolutePath && basecount)
+	{
+		nbase = basecount - 1;
+	}
+	count = nbase + refcount;
+	*segs = segbuf;
+	if(count > URI_REBASE_SEGS_)
+	{
+		*segs = (UriPathSegmentA *) uri_mem_alloc_(count * sizeof(UriPathSegmentA));
+		if(!*segs)
+		{
+			return -1;
+		}
+	}
+	if(nbase)
+	{
+		memcpy(*segs, base->pathHead, nbase * sizeof(UriPathSegmentA));
+	}
+	if(refcount)
+	{
+		memcpy(*segs + nbase, ref->pathHead, refcount * sizeof(UriPathSegmentA));
+	}
+	count = uri_rebase_dots_(*segs, count);
+	if(!count && !ref->hostText.first && target->hostText.first)
+	{
+		/* The merged path follows an authority, so it is at least "/",
+		 * which is represented by a single empty segment
+		 */
+		(*segs)[0].text.first = (*segs)[0].text.afterLast = "";
+		count = 1;
+	}
+	for(c = 0; c < count; c++)
+	{
+		(*segs)[c].next = (c + 1 < count ? &((*segs)[c + 1]) : NULL);
+	}
+	target->pathHead = (count ? *segs : NULL);
+	target->pathTail = (count ? &((*segs)[count - 1]) : NULL);
+	/* As with uriparser, the path is only flagged as absolute when there
+	 * is no authority
+	 */
+	if(!target->hostText.first)
+	{
+		target->absolutePath = ((ref->absolutePath || base->absolutePath) ? URI_TRUE : URI_FALSE);
+	}
 	return 0;
 }
 
+/* Internal: remove the "." and ".." segments from the count segments of a
+ * path, as described by RFC 3986 section 5.2.4, returning the number which
+ * remain; a path which ends with one of these segments retains a trailing
+ * slash
+ */
+static size_t
+uri_rebase_dots_(UriPathSegmentA *segs, size_t count)
+{
+	static const char empty[] = "";
+	const char *p;
+	size_t c, n, len;
+
+	n = 0;
+	for(c = 0; c < count; c++)
+	{
+		p = segs[c].text.first;
+		len = segs[c].text.afterLast - p;
+		if(len == 2 && p[0] == '.' && p[1] == '.')
+		{
+			if(n)
+			{
+				n--;
+			}
+		}
+		else if(len != 1 || p[0] != '.')
+		{
+			segs[n] = segs[c];
+			n++;
+			continue;
+		}
+		if(c + 1 == count)
+		{
+			segs[n].text.first = segs[n].text.afterLast = empty;
+			n++;
+		}
+	}
+	return n;
+}
+
+/* Internal: rebase reluri against a non-hierarchical base. Only a reference
+ * consisting of a query and/or fragment can be resolved against an opaque
+ * base; anything else is left unchanged.
+ */
 static int
 uri_rebase_nonhier_(URI *restrict reluri, const URI *restrict base)
 {
-	/* Currently not possible */
-#warning Handling non-hierarchical URIs is not yet supported
-	errno = EPERM;
-	return -1;
+	URI abstemp;
+	UriUriA parsed, relmirror, basemirror;
+
+	if(reluri->hoststr || reluri->pathfirst || reluri->pathabs)
+	{
+		return 0;
+	}
+	uri_mirror_(reluri, &relmirror);
+	uri_mirror_(base, &basemirror);
+	memset(&parsed, 0, sizeof(UriUriA));
+	parsed.scheme = basemirror.scheme;
+	parsed.pathHead = basemirror.pathHead;
+	parsed.pathTail = basemirror.pathTail;
+	parsed.query = (relmirror.query.first ? relmirror.query : basemirror.query);
+	parsed.fragment = relmirror.fragment;
+	memset(&abstemp, 0, sizeof(URI));
+	abstemp.arena = reluri->arena;
+	if(uri_store_(&abstemp, &parsed))
+	{
+		uri_reset_(&abstemp);
+		return -1;
+	}
+	abstemp.nss = (char *) abstemp.pathfirst->text.first;
+	abstemp.normalise = reluri->normalise;
+	abstemp.normalised = base->normalised;
+	/* Free the resources used by reluri, replace its contents with that
+	 * from absolute.
+	 */
+	uri_reset_(reluri);
+	uri_move_(reluri, &abstemp);
+	return 0;
 }
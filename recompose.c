@@ -20,19 +20,325 @@
 
 #include "p_liburi.h"
 
+/* The recomposed form of a URI is cached along with the offset of each of
+ * its components. Setters mark the cache as stale from the component they
+ * change onwards, so that the next call to uri_str() only has to rebuild
+ * the tail which follows the last unchanged component. Once the cache is
+ * current, it is only ever read until the URI is next modified (which
+ * requires exclusive access to the URI anyway); if several threads find
+ * it stale at once, one rebuilds it while the others recompose the URI
+ * directly.
+ */
+
+/* The number of iovec entries which uri_write() and uri_write_fd() can
+ * describe a URI with before allocating
+ */
+#define URI_IOV_ENTRIES_               32
+
+#ifndef IOV_MAX
+# define IOV_MAX                       16
+#endif
+
+static int uri_recomposed_(const URI *curi);
+static size_t uri_iov_alloc_(const URI *uri, struct iovec *iovbuf, struct iovec **iov);
+static void uri_recomposed_authority_(const URI *restrict uri, UriUriA *restrict authority);
+static size_t uri_recomposed_len_(const URI *restrict uri, unsigned int component, const UriUriA *restrict authority);
+static void uri_recomposed_write_(const URI *restrict uri, unsigned int component, const UriUriA *restrict authority, char *restrict p, size_t len);
+
 size_t
 uri_str(const URI *restrict uri, char *restrict buf, size_t buflen)
+{
+	UriUriA mirror;
+	size_t len;
+	int r;
+
+	uri_lazy_(uri, URI_LAZY_ALL_);
+	if(uri->normalise == URI_PARSE_NORMALISE_LAZY && uri_normalise((URI *) uri))
+	{
+		return (size_t) -1;
+	}
+	r = uri_recomposed_(uri);
+	if(r < 0)
+	{
+		return (size_t) -1;
+	}
+	if(r)
+	{
+		/* Another thread is rebuilding the cached form */
+		uri_mirror_(uri, &mirror);
+		return uri_recompose_(&mirror, buf, buflen);
+	}
+	len = uri->composedoff[URI_COMPOSED_COUNT_];
+	if(buf && buflen)
+	{
+		if(buflen <= len)
+		{
+			return (size_t) -1;
+		}
+		memcpy(buf, uri->composed, len + 1);
+	}
+	return len + 1;
+}
+
+/* Internal: mark the cached recomposed form of a URI as stale from the
+ * given component (URI_COMPOSED_xxx_) onwards
+ */
+void
+uri_recomposed_dirty_(URI *uri, unsigned int component)
+{
+	if(uri->composedvalid > component)
+	{
+		uri->composedvalid = component;
+	}
+}
+
+/* Internal: bring the cached recomposed form of a URI up to date, which
+ * must have had all of its components materialised; returns 1 if another
+ * thread is already doing so, in which case the cache must not be used
+ */
+static int
+uri_recomposed_(const URI *curi)
+{
+	URI *uri = (URI *) curi;
+	UriUriA authority;
+	size_t off[URI_COMPOSED_COUNT_ + 1];
+	unsigned int from, c;
+	char *p;
+
+	if(__atomic_load_n(&(uri->composedvalid), __ATOMIC_ACQUIRE) == URI_COMPOSED_COUNT_)
+	{
+		return 0;
+	}
+	if(__atomic_exchange_n(&(uri->composing), 1, __ATOMIC_ACQUIRE))
+	{
+		return 1;
+	}
+	from = uri->composedvalid;
+	if(from == URI_COMPOSED_COUNT_)
+	{
+		/* Another thread brought it up to date in the meantime */
+		__atomic_store_n(&(uri->composing), 0, __ATOMIC_RELEASE);
+		return 0;
+	}
+	memset(&authority, 0, sizeof(UriUriA));
+	if(from <= URI_COMPOSED_AUTHORITY_)
+	{
+		uri_recomposed_authority_(uri, &authority);
+	}
+	off[from] = (from ? uri->composedoff[from] : 0);
+	for(c = from; c < URI_COMPOSED_COUNT_; c++)
+	{
+		off[c + 1] = off[c] + uri_recomposed_len_(uri, c, &authority);
+	}
+	if(off[URI_COMPOSED_COUNT_] + 1 > uri->composedsize)
+	{
+		if(uri->arena)
+		{
+			p = (char *) uri_arena_alloc_(uri->arena, off[URI_COMPOSED_COUNT_] + 1);
+			if(p && off[from])
+			{
+				memcpy(p, uri->composed, off[from]);
+			}
+		}
+		else
+		{
+			p = (char *) uri_mem_realloc_(uri->composed, off[URI_COMPOSED_COUNT_] + 1);
+		}
+		if(!p)
+		{
+			__atomic_store_n(&(uri->composing), 0, __ATOMIC_RELEASE);
+			return -1;
+		}
+		uri->composed = p;
+		uri->composedsize = off[URI_COMPOSED_COUNT_] + 1;
+	}
+	for(c = from; c < URI_COMPOSED_COUNT_; c++)
+	{
+		uri_recomposed_write_(uri, c, &authority, uri->composed + off[c], off[c + 1] - off[c]);
+		uri->composedoff[c + 1] = off[c + 1];
+	}
+	uri->composed[off[URI_COMPOSED_COUNT_]] = 0;
+	uri->composedoff[0] = 0;
+	__atomic_store_n(&(uri->composedvalid), URI_COMPOSED_COUNT_, __ATOMIC_RELEASE);
+	__atomic_store_n(&(uri->composing), 0, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Internal: determine the length of the recomposed form of a URI, whose
+ * components must all have been materialised, without using or updating
+ * the cached form (so that several threads may do so at once); authority
+ * is populated for the benefit of uri_composed_write_()
+ */
+size_t
+uri_composed_len_(const URI *restrict uri, UriUriA *restrict authority)
+{
+	size_t len;
+	unsigned int c;
+
+	memset(authority, 0, sizeof(UriUriA));
+	uri_recomposed_authority_(uri, authority);
+	len = 0;
+	for(c = 0; c < URI_COMPOSED_COUNT_; c++)
+	{
+		len += uri_recomposed_len_(uri, c, authority);
+	}
+	return len;
+}
+
+/* Internal: write the recomposed form of a URI, whose length has been
+ * determined by uri_composed_len_(), to p; no terminating null is added,
+ * but the byte following the URI may be overwritten
+ */
+void
+uri_composed_write_(const URI *restrict uri, const UriUriA *restrict authority, char *restrict p)
+{
+	size_t len;
+	unsigned int c;
+
+	for(c = 0; c < URI_COMPOSED_COUNT_; c++)
+	{
+		len = uri_recomposed_len_(uri, c, authority);
+		uri_recomposed_write_(uri, c, authority, p, len);
+		p += len;
+	}
+}
+
+/* Internal: if the host of a URI is one which uriparser holds in parsed
+ * form, populate authority with the components which uriparser needs in
+ * order to recompose it; everything else is copied directly from the
+ * URI's components
+ */
+static void
+uri_recomposed_authority_(const URI *restrict uri, UriUriA *restrict authority)
+{
+	UriUriA mirror;
+
+	if(uri->hostdata.ip4 || uri->hostdata.ip6 || uri->hostdata.ipFuture.first)
+	{
+		uri_mirror_(uri, &mirror);
+		authority->userInfo = mirror.userInfo;
+		authority->hostText = mirror.hostText;
+		authority->hostData = mirror.hostData;
+		authority->portText = mirror.portText;
+	}
+}
+
+/* Internal: determine the length of a component of the recomposed form of
+ * a URI, including its delimiters; if authority has a host, it is used to
+ * recompose the authority
+ */
+static size_t
+uri_recomposed_len_(const URI *restrict uri, unsigned int component, const UriUriA *restrict authority)
+{
+	switch(component)
+	{
+		case URI_COMPOSED_SCHEME_:
+			return (uri->scheme ? uri->schemelen + 1 : 0);
+		case URI_COMPOSED_AUTHORITY_:
+			if(authority->hostText.first)
+			{
+				return uri_recompose_(authority, NULL, 0) - 1;
+			}
+			if(!uri->hoststr)
+			{
+				return 0;
+			}
+			return 2 + (uri->auth ? uri->authlen + 1 : 0) + uri->hostlen + (uri->portstr ? uri->portlen + 1 : 0);
+		case URI_COMPOSED_PATH_:
+			return ((uri->pathabs || (uri->hoststr && uri->pathfirst)) ? 1 : 0) + uri->pathlen;
+		case URI_COMPOSED_QUERY_:
+			return (uri->query ? uri->querylen + 1 : 0);
+		case URI_COMPOSED_FRAGMENT_:
+			return (uri->fragment ? uri->fragmentlen + 1 : 0);
+	}
+	return 0;
+}
+
+/* Internal: write a component of the recomposed form of a URI, which is
+ * len characters long, to p
+ */
+static void
+uri_recomposed_write_(const URI *restrict uri, unsigned int component, const UriUriA *restrict authority, char *restrict p, size_t len)
+{
+	const UriPathSegmentA *seg;
+	size_t l;
+
+	if(!len)
+	{
+		return;
+	}
+	switch(component)
+	{
+		case URI_COMPOSED_SCHEME_:
+			memcpy(p, uri->scheme, uri->schemelen);
+			p[uri->schemelen] = ':';
+			break;
+		case URI_COMPOSED_AUTHORITY_:
+			if(authority->hostText.first)
+			{
+				/* This writes a terminating null, which is overwritten
+				 * by the following component or the final terminator
+				 */
+				uri_recompose_(authority, p, len + 1);
+				break;
+			}
+			*p++ = '/';
+			*p++ = '/';
+			if(uri->auth)
+			{
+				memcpy(p, uri->auth, uri->authlen);
+				p += uri->authlen;
+				*p++ = '@';
+			}
+			memcpy(p, uri->hoststr, uri->hostlen);
+			p += uri->hostlen;
+			if(uri->portstr)
+			{
+				*p++ = ':';
+				memcpy(p, uri->portstr, uri->portlen);
+			}
+			break;
+		case URI_COMPOSED_PATH_:
+			if(uri->pathabs || (uri->hoststr && uri->pathfirst))
+			{
+				*p++ = '/';
+			}
+			for(seg = uri->pathfirst; seg; seg = seg->next)
+			{
+				l = seg->text.afterLast - seg->text.first;
+				memcpy(p, seg->text.first, l);
+				p += l;
+				if(seg->next)
+				{
+					*p++ = '/';
+				}
+			}
+			break;
+		case URI_COMPOSED_QUERY_:
+			*p = '?';
+			memcpy(p + 1, uri->query, uri->querylen);
+			break;
+		case URI_COMPOSED_FRAGMENT_:
+			*p = '#';
+			memcpy(p + 1, uri->fragment, uri->fragmentlen);
+			break;
+	}
+}
+
+/* Internal: recompose the components of src into buf, as uri_str() */
+size_t
+uri_recompose_(const UriUriA *restrict src, char *restrict buf, size_t buflen)
 {
 	int bufsize;
 
-	if(uriToStringCharsRequiredA(&(uri->uri), &bufsize) != URI_SUCCESS)
+	if(uriToStringCharsRequiredA(src, &bufsize) != URI_SUCCESS)
 	{
 		return (size_t) -1;
 	}
 	bufsize++;
 	if(buf && buflen)
 	{
-		if(uriToStringA(buf, &(uri->uri), buflen, NULL) != URI_SUCCESS)
+		if(uriToStringA(buf, src, buflen, NULL) != URI_SUCCESS)
 		{
 			return (size_t) -1;
 		}
@@ -59,3 +365,188 @@ uri_stralloc(const URI *restrict uri)
 	}
 	return str;
 }
+
+/* Describe a URI as an array of iovec structures pointing at its
+ * components, interleaved with static delimiters, in the same order as
+ * uri_str() would write them
+ */
+size_t
+uri_iov(const URI *restrict uri, struct iovec *restrict iov, size_t iovcnt)
+{
+	const UriPathSegmentA *seg;
+	size_t n;
+
+	uri_lazy_(uri, URI_LAZY_ALL_);
+	if(uri->normalise == URI_PARSE_NORMALISE_LAZY && uri_normalise((URI *) uri))
+	{
+		return (size_t) -1;
+	}
+	n = 0;
+#define URI_IOV_(str, len) \
+	if((len)) \
+	{ \
+		if(n < iovcnt) \
+		{ \
+			iov[n].iov_base = (void *) (str); \
+			iov[n].iov_len = (len); \
+		} \
+		n++; \
+	}
+	if(uri->scheme)
+	{
+		URI_IOV_(uri->scheme, uri->schemelen);
+		URI_IOV_(":", 1);
+	}
+	if(uri->hoststr)
+	{
+		URI_IOV_("//", 2);
+		if(uri->auth)
+		{
+			URI_IOV_(uri->auth, uri->authlen);
+			URI_IOV_("@", 1);
+		}
+		/* A host which uriparser holds in parsed form is recomposed from
+		 * that rather than from hoststr
+		 */
+		if(uri->hostlit)
+		{
+			URI_IOV_(uri->hostlit, uri->hostlitlen);
+		}
+		else
+		{
+			URI_IOV_(uri->hoststr, uri->hostlen);
+		}
+		if(uri->portstr)
+		{
+			URI_IOV_(":", 1);
+			URI_IOV_(uri->portstr, uri->portlen);
+		}
+	}
+	if(uri->pathabs || (uri->hoststr && uri->pathfirst))
+	{
+		URI_IOV_("/", 1);
+	}
+	for(seg = uri->pathfirst; seg; seg = seg->next)
+	{
+		URI_IOV_(seg->text.first, (size_t) (seg->text.afterLast - seg->text.first));
+		if(seg->next)
+		{
+			URI_IOV_("/", 1);
+		}
+	}
+	if(uri->query)
+	{
+		URI_IOV_("?", 1);
+		URI_IOV_(uri->query, uri->querylen);
+	}
+	if(uri->fragment)
+	{
+		URI_IOV_("#", 1);
+		URI_IOV_(uri->fragment, uri->fragmentlen);
+	}
+#undef URI_IOV_
+	return n;
+}
+
+/* Stream a URI to a sink, one piece at a time */
+int
+uri_write(const URI *restrict uri, const URI_SINK *restrict sink)
+{
+	struct iovec iovbuf[URI_IOV_ENTRIES_], *iov;
+	size_t count, c;
+	int r;
+
+	count = uri_iov_alloc_(uri, iovbuf, &iov);
+	if(count == (size_t) -1)
+	{
+		return -1;
+	}
+	r = 0;
+	for(c = 0; c < count && !r; c++)
+	{
+		r = sink->write(sink->data, (const char *) iov[c].iov_base, iov[c].iov_len);
+	}
+	if(iov != iovbuf)
+	{
+		uri_mem_free_(iov);
+	}
+	return (r ? -1 : 0);
+}
+
+/* Write a URI to a file descriptor with writev() */
+int
+uri_write_fd(const URI *uri, int fd)
+{
+	struct iovec iovbuf[URI_IOV_ENTRIES_], *iov;
+	size_t count, c;
+	ssize_t w;
+	int r;
+
+	count = uri_iov_alloc_(uri, iovbuf, &iov);
+	if(count == (size_t) -1)
+	{
+		return -1;
+	}
+	r = 0;
+	c = 0;
+	while(c < count)
+	{
+		w = writev(fd, &(iov[c]), (int) (count - c > IOV_MAX ? IOV_MAX : count - c));
+		if(w < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			r = -1;
+			break;
+		}
+		/* Skip the entries which were written in full, and resume a
+		 * partially-written one where it was left
+		 */
+		for(; c < count && (size_t) w >= iov[c].iov_len; c++)
+		{
+			w -= iov[c].iov_len;
+		}
+		if(c < count)
+		{
+			iov[c].iov_base = (char *) iov[c].iov_base + w;
+			iov[c].iov_len -= w;
+		}
+	}
+	if(iov != iovbuf)
+	{
+		uri_mem_free_(iov);
+	}
+	return r;
+}
+
+/* Internal: describe a URI as an array of iovec structures, using iovbuf
+ * (which has room for URI_IOV_ENTRIES_) if it's large enough or a new
+ * array otherwise, which *iov is set to
+ */
+static size_t
+uri_iov_alloc_(const URI *uri, struct iovec *iovbuf, struct iovec **iov)
+{
+	size_t count;
+
+	*iov = iovbuf;
+	count = uri_iov(uri, iovbuf, URI_IOV_ENTRIES_);
+	if(count == (size_t) -1 || count <= URI_IOV_ENTRIES_)
+	{
+		return count;
+	}
+	*iov = (struct iovec *) uri_mem_alloc_(count * sizeof(struct iovec));
+	if(!*iov)
+	{
+		*iov = iovbuf;
+		return (size_t) -1;
+	}
+	count = uri_iov(uri, *iov, count);
+	if(count == (size_t) -1)
+	{
+		uri_mem_free_(*iov);
+		*iov = iovbuf;
+	}
+	return count;
+}
@@ -0,0 +1,368 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* Relative reference generation: the inverse of uri_rebase(). The
+ * reference is assembled from the components and path segments already
+ * held by the target URI, with the portion of the path which it shares
+ * with the base replaced by "..", and is then either stored as a new URI
+ * or recomposed directly into a buffer.
+ */
+
+static URI *uri_relativize_(const URI *restrict uri, const URI *restrict base, struct uri_arena_struct *arena);
+static int uri_relativize_ref_(const URI *restrict uri, const URI *restrict base, UriUriA *restrict ref, UriPathSegmentA *segbuf, UriPathSegmentA **segs);
+static int uri_relativize_path_(const URI *restrict uri, const URI *restrict base, UriUriA *restrict ref, UriPathSegmentA *segbuf, UriPathSegmentA **segs);
+static int uri_relativize_eq_(const char *a, size_t alen, const char *b, size_t blen, int nocase);
+static int uri_relativize_segeq_(const UriPathSegmentA *a, const UriPathSegmentA *b);
+static void uri_relativize_free_(UriPathSegmentA *segbuf, UriPathSegmentA *segs);
+
+/* Create the shortest reference which resolves to uri against base. If
+ * uri can't be expressed relative to base (for example, because their
+ * schemes differ), the result is a copy of uri.
+ */
+URI *
+uri_relativize(const URI *restrict uri, const URI *restrict base)
+{
+	return uri_relativize_(uri, base, NULL);
+}
+
+/* As uri_relativize(), but recomposing the reference directly into buf in
+ * the same way as uri_str()
+ */
+size_t
+uri_relativize_str(const URI *restrict uri, const URI *restrict base, char *restrict buf, size_t buflen)
+{
+	UriUriA ref;
+	UriPathSegmentA segbuf[URI_REBASE_SEGS_], *segs;
+	size_t r;
+
+	if(uri_relativize_ref_(uri, base, &ref, segbuf, &segs) < 0)
+	{
+		return (size_t) -1;
+	}
+	r = uri_recompose_(&ref, buf, buflen);
+	uri_relativize_free_(segbuf, segs);
+	return r;
+}
+
+/* Create references to each of an array of URIs relative to the base of a
+ * resolver, allocating them from a single arena; an entry is NULL if that
+ * URI couldn't be relativized
+ */
+URI_BATCH *
+uri_resolver_relativize(const URI_RESOLVER *restrict resolver, const URI *const *restrict uris, size_t count)
+{
+	URI_BATCH *batch;
+	size_t c;
+
+	batch = (URI_BATCH *) uri_mem_calloc_(1, sizeof(URI_BATCH));
+	if(!batch)
+	{
+		return NULL;
+	}
+	batch->count = count;
+	if(count)
+	{
+		batch->uris = (URI **) uri_arena_alloc_(&(batch->arena), count * sizeof(URI *));
+		if(!batch->uris)
+		{
+			uri_batch_destroy(batch);
+			return NULL;
+		}
+	}
+	for(c = 0; c < count; c++)
+	{
+		batch->uris[c] = uri_relativize_(uris[c], resolver->base, &(batch->arena));
+		if(!batch->uris[c] && errno == ENOMEM)
+		{
+			uri_batch_destroy(batch);
+			return NULL;
+		}
+	}
+	return batch;
+}
+
+/* Internal: create the reference to uri relative to base, allocating it
+ * from arena if it is non-NULL
+ */
+static URI *
+uri_relativize_(const URI *restrict uri, const URI *restrict base, struct uri_arena_struct *arena)
+{
+	UriUriA ref;
+	UriPathSegmentA segbuf[URI_REBASE_SEGS_], *segs;
+	URI *p;
+	int unchanged;
+
+	unchanged = uri_relativize_ref_(uri, base, &ref, segbuf, &segs);
+	if(unchanged < 0)
+	{
+		return NULL;
+	}
+	p = uri_create_(uri_store_size_(&ref), arena);
+	if(p && uri_store_(p, &ref))
+	{
+		uri_destroy(p);
+		p = NULL;
+	}
+	uri_relativize_free_(segbuf, segs);
+	if(!p)
+	{
+		return NULL;
+	}
+	p->hier = (unchanged ? uri->hier : 1);
+	/* The NSS of a non-hierarchical URI is the text of its only path
+	 * segment
+	 */
+	if(!p->hier && p->pathfirst)
+	{
+		p->nss = (char *) p->pathfirst->text.first;
+	}
+	p->normalise = uri->normalise;
+	p->normalised = uri->normalised;
+	return p;
+}
+
+/* Internal: populate ref with the components of the reference to uri
+ * relative to base, referring to the storage of uri; returns 1 if the
+ * reference is uri itself, 0 if it is relative, or -1 on error. Any path
+ * segments which have to be assembled are placed in segbuf or a new array
+ * as described for uri_resolve_().
+ */
+static int
+uri_relativize_ref_(const URI *restrict uri, const URI *restrict base, UriUriA *restrict ref, UriPathSegmentA *segbuf, UriPathSegmentA **segs)
+{
+	UriUriA mirror;
+	size_t c;
+
+	*segs = NULL;
+	uri_lazy_(uri, URI_LAZY_ALL_);
+	uri_lazy_(base, URI_LAZY_ALL_);
+	if(!base->absolute)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if((uri->normalise == URI_PARSE_NORMALISE_LAZY && uri_normalise((URI *) uri)) ||
+		(base->normalise == URI_PARSE_NORMALISE_LAZY && uri_normalise((URI *) base)))
+	{
+		return -1;
+	}
+	uri_mirror_(uri, &mirror);
+	*ref = mirror;
+	if(!uri->absolute || !uri->hier || !base->hier ||
+		!uri_relativize_eq_(uri->scheme, uri->schemelen, base->scheme, base->schemelen, 1))
+	{
+		return 1;
+	}
+	/* Beyond this point, the reference never has a scheme; if the
+	 * authorities differ, it is a network-path reference
+	 */
+	memset(&(ref->scheme), 0, sizeof(UriTextRangeA));
+	if(!uri_relativize_eq_(uri->auth, uri->authlen, base->auth, base->authlen, 0) ||
+		!uri_relativize_eq_(uri->hoststr, uri->hostlen, base->hoststr, base->hostlen, 1) ||
+		!uri_relativize_eq_(uri->portstr, uri->portlen, base->portstr, base->portlen, 0))
+	{
+		if(!uri->hoststr)
+		{
+			/* A reference without an authority would inherit the
+			 * base's, so uri is used as-is
+			 */
+			*ref = mirror;
+			return 1;
+		}
+		return 0;
+	}
+	memset(&(ref->userInfo), 0, sizeof(UriTextRangeA));
+	memset(&(ref->hostText), 0, sizeof(UriTextRangeA));
+	memset(&(ref->hostData), 0, sizeof(ref->hostData));
+	memset(&(ref->portText), 0, sizeof(UriTextRangeA));
+	if(uri->pathcount == base->pathcount && uri->pathabs == base->pathabs)
+	{
+		for(c = 0; c < uri->pathcount && uri_relativize_segeq_(&(uri->pathfirst[c]), &(base->pathfirst[c])); c++);
+		if(c == uri->pathcount)
+		{
+			/* The paths are the same, so the reference need only contain
+			 * the query (if the base's differs) and the fragment; a path
+			 * is still needed if the base has a query and uri doesn't
+			 */
+			ref->pathHead = ref->pathTail = NULL;
+			ref->absolutePath = URI_FALSE;
+			if(uri_relativize_eq_(uri->query, uri->querylen, base->query, base->querylen, 0))
+			{
+				memset(&(ref->query), 0, sizeof(UriTextRangeA));
+				return 0;
+			}
+			if(uri->query)
+			{
+				return 0;
+			}
+		}
+	}
+	return uri_relativize_path_(uri, base, ref, segbuf, segs);
+}
+
+/* Internal: populate the path of ref with the shorter of a relative-path
+ * reference or an absolute-path reference to the path of uri from that of
+ * base, which have the same scheme and authority
+ */
+static int
+uri_relativize_path_(const URI *restrict uri, const URI *restrict base, UriUriA *restrict ref, UriPathSegmentA *segbuf, UriPathSegmentA **segs)
+{
+	static const char dot[] = ".", dotdot[] = "..";
+	const UriPathSegmentA *tseg;
+	size_t ndir, k, ups, relcount, rellen, abslen, count, c;
+	int prefix, absolute;
+
+	if(!uri->pathcount)
+	{
+		if(uri->hoststr)
+		{
+			/* An empty path following an authority can only be expressed
+			 * with a network-path reference
+			 */
+			uri_mirror_(uri, ref);
+			memset(&(ref->scheme), 0, sizeof(UriTextRangeA));
+			return 0;
+		}
+		ref->pathHead = ref->pathTail = NULL;
+		ref->absolutePath = URI_TRUE;
+		return 0;
+	}
+	tseg = uri->pathfirst;
+	/* The segments of the base's directory which uri shares; the last
+	 * segment of uri is always part of the reference
+	 */
+	ndir = (base->pathcount ? base->pathcount - 1 : 0);
+	for(k = 0; k < ndir && k + 1 < uri->pathcount && uri_relativize_segeq_(&(tseg[k]), &(base->pathfirst[k])); k++);
+	ups = ndir - k;
+	relcount = uri->pathcount - k;
+	/* Without a leading "..", a reference whose first segment is empty
+	 * would be taken as an authority or an absolute path, and one whose
+	 * first segment contains a colon as a scheme, so "./" is prepended
+	 */
+	prefix = 0;
+	if(!ups && (tseg[k].text.first == tseg[k].text.afterLast ||
+		memchr(tseg[k].text.first, ':', tseg[k].text.afterLast - tseg[k].text.first)))
+	{
+		prefix = 1;
+	}
+	rellen = ups * 3 + prefix * 2 + (relcount - 1);
+	for(c = k; c < uri->pathcount; c++)
+	{
+		rellen += tseg[c].text.afterLast - tseg[c].text.first;
+	}
+	/* An absolute path can't begin with an empty segment, which would be
+	 * taken as an authority
+	 */
+	abslen = 1 + uri->pathlen;
+	absolute = (abslen < rellen && (uri->pathcount == 1 || tseg[0].text.first != tseg[0].text.afterLast));
+	if(absolute)
+	{
+		count = uri->pathcount;
+		k = 0;
+		ups = 0;
+		prefix = 0;
+	}
+	else
+	{
+		count = ups + prefix + relcount;
+	}
+	*segs = segbuf;
+	if(count > URI_REBASE_SEGS_)
+	{
+		*segs = (UriPathSegmentA *) uri_mem_alloc_(count * sizeof(UriPathSegmentA));
+		if(!*segs)
+		{
+			return -1;
+		}
+	}
+	memset(*segs, 0, (ups + prefix) * sizeof(UriPathSegmentA));
+	for(c = 0; c < ups; c++)
+	{
+		(*segs)[c].text.first = dotdot;
+		(*segs)[c].text.afterLast = dotdot + 2;
+	}
+	if(prefix)
+	{
+		(*segs)[c].text.first = dot;
+		(*segs)[c].text.afterLast = dot + 1;
+	}
+	memcpy(*segs + ups + prefix, &(tseg[k]), (count - ups - prefix) * sizeof(UriPathSegmentA));
+	for(c = 0; c < count; c++)
+	{
+		(*segs)[c].next = (c + 1 < count ? &((*segs)[c + 1]) : NULL);
+	}
+	ref->pathHead = *segs;
+	ref->pathTail = &((*segs)[count - 1]);
+	ref->absolutePath = (absolute ? URI_TRUE : URI_FALSE);
+	return 0;
+}
+
+/* Internal: compare two components, either of which may be absent */
+static int
+uri_relativize_eq_(const char *a, size_t alen, const char *b, size_t blen, int nocase)
+{
+	size_t c;
+	int ca, cb;
+
+	if(!a || !b)
+	{
+		return (a == b);
+	}
+	if(alen != blen)
+	{
+		return 0;
+	}
+	if(!nocase)
+	{
+		return !memcmp(a, b, alen);
+	}
+	for(c = 0; c < alen; c++)
+	{
+		ca = (a[c] >= 'A' && a[c] <= 'Z' ? a[c] + 32 : a[c]);
+		cb = (b[c] >= 'A' && b[c] <= 'Z' ? b[c] + 32 : b[c]);
+		if(ca != cb)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Internal: compare the text of two path segments */
+static int
+uri_relativize_segeq_(const UriPathSegmentA *a, const UriPathSegmentA *b)
+{
+	return uri_relativize_eq_(a->text.first, a->text.afterLast - a->text.first, b->text.first, b->text.afterLast - b->text.first, 0);
+}
+
+/* Internal: release the path segment array assembled for a reference */
+static void
+uri_relativize_free_(UriPathSegmentA *segbuf, UriPathSegmentA *segs)
+{
+	if(segs && segs != segbuf)
+	{
+		uri_mem_free_(segs);
+	}
+}
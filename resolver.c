@@ -0,0 +1,193 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* A resolver binds a base URI so that a sequence of references (such as
+ * the links found within a document) can be resolved against it without
+ * repeating the work which depends only upon the base. The base is
+ * duplicated and its components are laid out once in the form which the
+ * merge in rebase.c operates on; each reference which the structural
+ * scanner finds to be in normal form is then split straight into path
+ * segments, merged with the base and copied into a single storage block,
+ * without an intermediate relative URI being created. Any other reference
+ * is parsed and rebased in the usual way.
+ */
+
+static URI *uri_resolver_parse_(const URI_RESOLVER *restrict resolver, const char *restrict str, size_t len, struct uri_arena_struct *arena);
+
+/* Create a resolver for the given base, which must be absolute */
+URI_RESOLVER *
+uri_resolver_create(const URI *base)
+{
+	URI_RESOLVER *resolver;
+
+	if(!base || !base->absolute)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	resolver = (URI_RESOLVER *) uri_mem_calloc_(1, sizeof(URI_RESOLVER));
+	if(!resolver)
+	{
+		return NULL;
+	}
+	resolver->base = uri_dup_(base);
+	if(!resolver->base)
+	{
+		uri_mem_free_(resolver);
+		return NULL;
+	}
+	uri_mirror_(resolver->base, &(resolver->mirror));
+	/* Merging a reference in normal form with a base in normal form
+	 * yields a target in normal form, so nothing further needs to be
+	 * done to it; otherwise, the target has to be normalised after the
+	 * merge, which uri_rebase() takes care of.
+	 */
+	resolver->direct = (resolver->base->hier && resolver->base->normalised);
+	return resolver;
+}
+
+/* Destroy a resolver */
+int
+uri_resolver_destroy(URI_RESOLVER *resolver)
+{
+	if(!resolver)
+	{
+		return 0;
+	}
+	uri_destroy(resolver->base);
+	uri_mem_free_(resolver);
+	return 0;
+}
+
+/* Resolve a reference against the resolver's base */
+URI *
+uri_resolver_resolve(const URI_RESOLVER *restrict resolver, const char *restrict str)
+{
+	return uri_resolver_parse_(resolver, str, strlen(str), NULL);
+}
+
+/* As uri_resolver_resolve(), resolving the first len characters of str */
+URI *
+uri_resolver_resolve_n(const URI_RESOLVER *restrict resolver, const char *restrict str, size_t len)
+{
+	return uri_resolver_parse_(resolver, str, len, NULL);
+}
+
+/* Resolve an array of UTF-8 references against the resolver's base,
+ * allocating all of the resulting URIs from a single arena; as with
+ * uri_batch_create(), an entry is NULL if that reference couldn't be
+ * parsed
+ */
+URI_BATCH *
+uri_resolver_batch(const URI_RESOLVER *restrict resolver, const unsigned char *const *restrict strs, size_t count)
+{
+	URI_BATCH *batch;
+	char *buf;
+	size_t c, buflen;
+
+	batch = (URI_BATCH *) uri_mem_calloc_(1, sizeof(URI_BATCH));
+	if(!batch)
+	{
+		return NULL;
+	}
+	batch->count = count;
+	if(count)
+	{
+		batch->uris = (URI **) uri_arena_alloc_(&(batch->arena), count * sizeof(URI *));
+		if(!batch->uris)
+		{
+			uri_batch_destroy(batch);
+			return NULL;
+		}
+	}
+	buf = NULL;
+	buflen = 0;
+	for(c = 0; c < count; c++)
+	{
+		if(uri_preprocess_ustr_(strs[c], strlen((const char *) strs[c]), &buf, &buflen))
+		{
+			if(errno == ENOMEM)
+			{
+				uri_mem_free_(buf);
+				uri_batch_destroy(batch);
+				return NULL;
+			}
+			continue;
+		}
+		batch->uris[c] = uri_resolver_parse_(resolver, buf, strlen(buf), &(batch->arena));
+	}
+	uri_mem_free_(buf);
+	return batch;
+}
+
+/* Internal: resolve len characters of an ASCII reference against the
+ * resolver's base, allocating the result from arena if it is non-NULL
+ */
+static URI *
+uri_resolver_parse_(const URI_RESOLVER *restrict resolver, const char *restrict str, size_t len, struct uri_arena_struct *arena)
+{
+	struct uri_scan_struct scan;
+	UriUriA ref, target;
+	UriPathSegmentA refsegs[URI_SCAN_MAXSEGS_], segbuf[URI_REBASE_SEGS_], *segs;
+	size_t refcount;
+	URI *uri;
+
+	if(!resolver->direct ||
+		uri_scan_(str, len, &scan) ||
+		scan.scheme.first ||
+		!uri_scan_normal_(&scan) ||
+		uri_scan_split_(&scan, &ref, refsegs, &refcount))
+	{
+		/* The reference is absolute, needs uriparser's attention (or to
+		 * be normalised), or the base isn't one which references can be
+		 * merged with directly
+		 */
+		return uri_parse_(str, len, resolver->base, arena);
+	}
+	if(uri_resolve_(&target, &ref, refcount, &(resolver->mirror), resolver->base->pathcount, segbuf, &segs))
+	{
+		return NULL;
+	}
+	uri = uri_create_(uri_store_size_(&target), arena);
+	if(uri)
+	{
+		uri->hier = 1;
+		if(uri_store_(uri, &target))
+		{
+			uri_destroy(uri);
+			uri = NULL;
+		}
+		else
+		{
+			uri->normalise = URI_PARSE_NORMALISE_EAGER;
+			uri->normalised = 1;
+		}
+	}
+	if(segs && segs != segbuf)
+	{
+		uri_mem_free_(segs);
+	}
+	return uri;
+}
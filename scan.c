@@ -0,0 +1,389 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* The structural scanner locates the component boundaries of a URI
+ * reference (RFC 3986 section 3) in a single pass over the string, validating
+ * the characters of each component as it goes. It does not allocate memory
+ * or modify the string, and the string need not be null-terminated.
+ *
+ * On x86 processors which support them, runs of characters within a
+ * component are skipped over 16 (SSSE3) or 32 (AVX2) bytes at a time;
+ * the instruction set is selected at runtime, and everything else is
+ * handled by the scalar code.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define URI_SCAN_X86_                  1
+# include <immintrin.h>
+#endif
+
+static const char *uri_scan_span_(const char *p, const char *end, unsigned char cclass, unsigned int *restrict flags);
+static const char *uri_scan_skip_(const char *p, const char *end, unsigned char cclass);
+static int uri_scan_authority_(struct uri_scan_struct *restrict scan, const char *p, const char *end);
+static void uri_scan_range_(UriTextRangeA *range, const char *first, const char *afterLast);
+
+#ifdef URI_SCAN_X86_
+static const char *uri_scan_ssse3_(const char *p, const char *end, const unsigned char *lut) __attribute__((target("ssse3")));
+static const char *uri_scan_avx2_(const char *p, const char *end, const unsigned char *lut) __attribute__((target("avx2")));
+#endif
+
+/* Character classes, indexed by octet; see the URI_CC_xxx_ definitions
+ * in p_liburi.h. Octets outside of the 7-bit ASCII range are never valid
+ * within a URI.
+ */
+const unsigned char uri_cclass_[256] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x1e, 0x00, 0x00, 0x1e, 0x1e, 0x1e, 0x1e,
+	0x1e, 0x1e, 0x1e, 0x1f, 0x1e, 0x1f, 0x1f, 0x18,
+	0xbf, 0xbf, 0xbf, 0xbf, 0xbf, 0xbf, 0xbf, 0xbf,
+	0xbf, 0xbf, 0x1a, 0x1e, 0x00, 0x1e, 0x00, 0x10,
+	0x18, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x5f,
+	0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f,
+	0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f,
+	0x5f, 0x5f, 0x5f, 0x00, 0x00, 0x00, 0x00, 0x1e,
+	0x00, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x5f,
+	0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f,
+	0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f,
+	0x5f, 0x5f, 0x5f, 0x00, 0x00, 0x00, 0x1e, 0x00
+};
+
+/* Nibble lookup tables used for vectorised class membership tests: for
+ * each class, entry n is a bitmap of the high nibbles h for which the octet
+ * (h << 4 | n) is a member of the class. '%' is deliberately excluded from
+ * every class, so that percent-encoded octets are always validated by the
+ * scalar code.
+ */
+static const unsigned char uri_scan_lut_[5][16] = {
+	/* URI_CC_SCHEME_ */
+	{ 0xa8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf0, 0x54, 0x50, 0x54, 0x54, 0x50 },
+	/* URI_CC_USERINFO_ */
+	{ 0xa8, 0xfc, 0xf8, 0xf8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc, 0x5c, 0x54, 0x5c, 0xd4, 0x70 },
+	/* URI_CC_HOST_ */
+	{ 0xa8, 0xfc, 0xf8, 0xf8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xf4, 0x5c, 0x54, 0x5c, 0xd4, 0x70 },
+	/* URI_CC_PATH_ */
+	{ 0xb8, 0xfc, 0xf8, 0xf8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc, 0x5c, 0x54, 0x5c, 0xd4, 0x74 },
+	/* URI_CC_QUERY_ */
+	{ 0xb8, 0xfc, 0xf8, 0xf8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc, 0x5c, 0x54, 0x5c, 0xd4, 0x7c }
+};
+
+/* The bit corresponding to each high nibble in the tables above; octets
+ * with the top bit set map to zero, and so are never class members
+ */
+static const unsigned char uri_scan_hibits_[16] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/* Internal: locate the components of the URI reference in str[0..len-1],
+ * storing their boundaries in scan. Returns 0 on success, or -1 (with errno
+ * set to EINVAL) if the string is not a syntactically-valid URI reference.
+ */
+int
+uri_scan_(const char *str, size_t len, struct uri_scan_struct *restrict scan)
+{
+	const char *p, *end, *t;
+
+	memset(scan, 0, sizeof(struct uri_scan_struct));
+	p = str;
+	end = str + len;
+	/* scheme ":" */
+	if(p < end && (uri_cclass_[(unsigned char) *p] & URI_CC_ALPHA_))
+	{
+		t = uri_scan_span_(p, end, URI_CC_SCHEME_, &(scan->flags));
+		if(t < end && *t == ':')
+		{
+			uri_scan_range_(&(scan->scheme), p, t);
+			p = t + 1;
+		}
+	}
+	/* "//" authority */
+	if(end - p >= 2 && p[0] == '/' && p[1] == '/')
+	{
+		p += 2;
+		for(t = p; t < end && *t != '/' && *t != '?' && *t != '#'; t++);
+		if(uri_scan_authority_(scan, p, t))
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		p = t;
+	}
+	/* path */
+	t = uri_scan_span_(p, end, URI_CC_PATH_, &(scan->flags));
+	if(t < end && *t != '?' && *t != '#')
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(t > p)
+	{
+		uri_scan_range_(&(scan->path), p, t);
+		/* In a relative reference without an authority, the first
+		 * segment of the path cannot contain a colon, as it would be
+		 * indistinguishable from a scheme
+		 */
+		if(!scan->scheme.first && !scan->host.first && *p != '/')
+		{
+			for(; p < t && *p != '/' && *p != ':'; p++);
+			if(p < t && *p == ':')
+			{
+				errno = EINVAL;
+				return -1;
+			}
+		}
+	}
+	p = t;
+	/* "?" query */
+	if(p < end && *p == '?')
+	{
+		p++;
+		t = uri_scan_span_(p, end, URI_CC_QUERY_, &(scan->flags));
+		if(t < end && *t != '#')
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		uri_scan_range_(&(scan->query), p, t);
+		p = t;
+	}
+	/* "#" fragment */
+	if(p < end && *p == '#')
+	{
+		p++;
+		t = uri_scan_span_(p, end, URI_CC_QUERY_, &(scan->flags));
+		if(t < end)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		uri_scan_range_(&(scan->fragment), p, t);
+	}
+	return 0;
+}
+
+/* Internal: split an authority into its userinfo, host and port and
+ * validate each
+ */
+static int
+uri_scan_authority_(struct uri_scan_struct *restrict scan, const char *p, const char *end)
+{
+	const char *t;
+
+	/* userinfo "@" */
+	t = (const char *) memchr(p, '@', end - p);
+	if(t)
+	{
+		if(uri_scan_span_(p, t, URI_CC_USERINFO_, &(scan->flags)) != t)
+		{
+			return -1;
+		}
+		uri_scan_range_(&(scan->userinfo), p, t);
+		p = t + 1;
+	}
+	/* host */
+	if(p < end && *p == '[')
+	{
+		/* IP-literal: the contents are validated loosely here, and
+		 * properly by uriparser when the URI is parsed in full
+		 */
+		t = uri_scan_span_(p + 1, end, URI_CC_USERINFO_, &(scan->flags));
+		if(t >= end || *t != ']')
+		{
+			return -1;
+		}
+		t++;
+		scan->flags |= URI_SCAN_IPLITERAL_;
+	}
+	else
+	{
+		t = uri_scan_span_(p, end, URI_CC_HOST_, &(scan->flags));
+	}
+	uri_scan_range_(&(scan->host), p, t);
+	p = t;
+	/* ":" port */
+	if(p < end)
+	{
+		if(*p != ':')
+		{
+			return -1;
+		}
+		for(t = p + 1; t < end && (uri_cclass_[(unsigned char) *t] & URI_CC_DIGIT_); t++);
+		if(t < end)
+		{
+			return -1;
+		}
+		uri_scan_range_(&(scan->port), p + 1, t);
+	}
+	return 0;
+}
+
+/* Internal: return a pointer to the first character in p[0..end-1] which
+ * is not a member of cclass, or end if all of them are. Percent-encoded
+ * octets are validated as they are encountered; if one is malformed, a
+ * pointer to the '%' is returned.
+ */
+static const char *
+uri_scan_span_(const char *p, const char *end, unsigned char cclass, unsigned int *restrict flags)
+{
+	while(p < end)
+	{
+		p = uri_scan_skip_(p, end, cclass);
+		if(p >= end || !(uri_cclass_[(unsigned char) *p] & cclass))
+		{
+			break;
+		}
+		if(*p == '%')
+		{
+			if(end - p < 3 ||
+			   !(uri_cclass_[(unsigned char) p[1]] & URI_CC_HEX_) ||
+			   !(uri_cclass_[(unsigned char) p[2]] & URI_CC_HEX_))
+			{
+				break;
+			}
+			*flags |= URI_SCAN_PCT_;
+			p += 3;
+			continue;
+		}
+		p++;
+	}
+	return p;
+}
+
+/* Internal: skip as many members of cclass (other than '%') as possible
+ * using vector instructions, returning a pointer to the first octet which
+ * needs to be examined by the scalar code
+ */
+static const char *
+uri_scan_skip_(const char *p, const char *end, unsigned char cclass)
+{
+#ifdef URI_SCAN_X86_
+	const unsigned char *lut;
+
+	if(end - p < 16)
+	{
+		return p;
+	}
+	switch(cclass)
+	{
+	case URI_CC_SCHEME_:
+		lut = uri_scan_lut_[0];
+		break;
+	case URI_CC_USERINFO_:
+		lut = uri_scan_lut_[1];
+		break;
+	case URI_CC_HOST_:
+		lut = uri_scan_lut_[2];
+		break;
+	case URI_CC_PATH_:
+		lut = uri_scan_lut_[3];
+		break;
+	case URI_CC_QUERY_:
+		lut = uri_scan_lut_[4];
+		break;
+	default:
+		return p;
+	}
+	if(end - p >= 32 && __builtin_cpu_supports("avx2"))
+	{
+		p = uri_scan_avx2_(p, end, lut);
+	}
+	if(__builtin_cpu_supports("ssse3"))
+	{
+		p = uri_scan_ssse3_(p, end, lut);
+	}
+#else
+	(void) end;
+	(void) cclass;
+#endif
+	return p;
+}
+
+#ifdef URI_SCAN_X86_
+/* Internal: the SSSE3 implementation of uri_scan_skip_(), which
+ * examines 16 octets at a time: the low and high nibbles of each octet
+ * are used to index the lookup tables, and the octet is a member of the
+ * class if the two results have a bit in common.
+ */
+static const char *
+uri_scan_ssse3_(const char *p, const char *end, const unsigned char *lut)
+{
+	const __m128i lolut = _mm_loadu_si128((const __m128i *) lut);
+	const __m128i hilut = _mm_loadu_si128((const __m128i *) uri_scan_hibits_);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	__m128i v, lo, hi;
+	unsigned int mask;
+
+	while(end - p >= 16)
+	{
+		v = _mm_loadu_si128((const __m128i *) p);
+		lo = _mm_shuffle_epi8(lolut, _mm_and_si128(v, nibble));
+		hi = _mm_shuffle_epi8(hilut, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+		mask = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()));
+		if(mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+		p += 16;
+	}
+	return p;
+}
+
+/* Internal: the AVX2 implementation of uri_scan_skip_(), identical to
+ * the SSSE3 version but examining 32 octets at a time
+ */
+static const char *
+uri_scan_avx2_(const char *p, const char *end, const unsigned char *lut)
+{
+	const __m256i lolut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) lut));
+	const __m256i hilut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) uri_scan_hibits_));
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	__m256i v, lo, hi;
+	unsigned int mask;
+
+	while(end - p >= 32)
+	{
+		v = _mm256_loadu_si256((const __m256i *) p);
+		lo = _mm256_shuffle_epi8(lolut, _mm256_and_si256(v, nibble));
+		hi = _mm256_shuffle_epi8(hilut, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+		mask = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256()));
+		if(mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+		p += 32;
+	}
+	return p;
+}
+#endif /*URI_SCAN_X86_*/
+
+static void
+uri_scan_range_(UriTextRangeA *range, const char *first, const char *afterLast)
+{
+	range->first = first;
+	range->afterLast = afterLast;
+}
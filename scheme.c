@@ -30,26 +30,24 @@
 size_t
 uri_scheme(const URI *restrict uri, char *restrict buf, size_t buflen)
 {
-	if(!uri->scheme)
-	{
-		if(buf && buflen)
-		{
-			*buf = 0;
-		}
-		return 0;
-	}
-	if(buf && buflen)
-	{
-		strncpy(buf, uri->scheme, buflen - 1);
-		buf[buflen - 1] = 0;
-	}
-	return strlen(uri->scheme) + 1;
+	uri_lazy_(uri, URI_LAZY_SCHEME_);
+	return uri_copy_(uri->scheme, uri->schemelen, buf, buflen);
 }
 
 /* Return the scheme as const string pointer */
 const char *
 uri_scheme_str(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_SCHEME_);
+	return uri->scheme;
+}
+
+/* Return the scheme as a pointer and length, without rescanning it */
+const char *
+uri_scheme_view(const URI *restrict uri, size_t *restrict len)
+{
+	uri_lazy_(uri, URI_LAZY_SCHEME_);
+	*len = uri->schemelen;
 	return uri->scheme;
 }
 
@@ -59,6 +57,7 @@ uri_scheme_str(const URI *uri)
 char *
 uri_scheme_stralloc(const URI *uri)
 {
+	uri_lazy_(uri, URI_LAZY_SCHEME_);
 	if(!uri->scheme)
 	{
 		errno = 0;
@@ -73,26 +72,20 @@ uri_set_scheme(URI *restrict uri, const char *restrict newscheme)
 {
 	char *sbuf;
 	
+	uri_lazy_(uri, URI_LAZY_SCHEME_);
 	sbuf = NULL;
 	if(newscheme)
 	{
-		sbuf = strdup(newscheme);
+		sbuf = uri_strdup_inline_(uri, newscheme, uri->schemebuf, sizeof(uri->schemebuf));
 		if(!sbuf)
 		{
 			return -1;
 		}
 		newscheme = sbuf;
 	}
-	free(uri->scheme);
+	uri_recomposed_dirty_(uri, URI_COMPOSED_SCHEME_);
+	uri_free_(uri, uri->scheme);
 	uri->scheme = sbuf;
-	uri->uri.scheme.first = sbuf;
-	if(sbuf)
-	{
-		uri->uri.scheme.afterLast = strchr(sbuf, 0);
-	}
-	else
-	{
-		uri->uri.scheme.afterLast = NULL;
-	}
+	uri->schemelen = (sbuf ? strlen(sbuf) : 0);
 	return 0;
 }
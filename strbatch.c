@@ -0,0 +1,294 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+/* Batch serialisation: an array of URIs is recomposed into a single
+ * buffer, each followed by a separator. The length of each URI is first
+ * determined from the cached lengths of its components (or its cached
+ * recomposed form, if that's current), which gives the offset of every
+ * entry; the buffer is then allocated once and each URI is written at its
+ * offset. Both passes can be divided between several threads, each of
+ * which handles a contiguous range of the array; the offsets are summed
+ * by the calling thread in between. Lazily-parsed components are
+ * materialised, and deferred normalisation carried out, by the calling
+ * thread beforehand, so that the threads only ever read the URIs.
+ */
+
+/* The smallest number of URIs which is worth handing to a thread of its
+ * own
+ */
+#define URI_STRBATCH_MINCHUNK_         1024
+
+struct uri_strbatch_struct
+{
+	const URI *const *uris;
+	size_t count;
+	int separator;
+	/* Initially the length of each entry (at index + 1), and then the
+	 * offset of each entry followed by the total length
+	 */
+	size_t *offsets;
+	char *buf;
+};
+
+struct uri_strbatch_worker_struct
+{
+	struct uri_strbatch_struct *job;
+	size_t first;
+	size_t last;
+};
+
+static int uri_strbatch_prepare_(const URI *const *uris, size_t count);
+static void uri_strbatch_run_(struct uri_strbatch_struct *job, unsigned nthreads, void *(*fn)(void *));
+static void *uri_strbatch_measure_(void *arg);
+static void *uri_strbatch_write_(void *arg);
+
+/* Recompose an array of URIs into a single buffer, each followed by
+ * separator (a NULL entry produces just the separator); the buffer is
+ * null-terminated and must be freed with free(). If offsets is non-NULL,
+ * it must have room for count + 1 entries, and receives the offset of
+ * each URI within the buffer followed by the total length, which is also
+ * stored in *len if len is non-NULL.
+ */
+char *
+uri_str_batch(const URI *const *restrict uris, size_t count, int separator, size_t *restrict offsets, size_t *restrict len)
+{
+	return uri_str_batch_parallel(uris, count, separator, offsets, len, 1);
+}
+
+/* As uri_str_batch(), using up to nthreads threads (including the calling
+ * thread) if the array is large enough to be worth dividing; if nthreads
+ * is zero, one thread per online processor is used
+ */
+char *
+uri_str_batch_parallel(const URI *const *restrict uris, size_t count, int separator, size_t *restrict offsets, size_t *restrict len, unsigned nthreads)
+{
+	struct uri_strbatch_struct job;
+	size_t c;
+	long ncpu;
+
+	if(!nthreads)
+	{
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpu > 0 ? (unsigned) ncpu : 1);
+	}
+	memset(&job, 0, sizeof(job));
+	job.uris = uris;
+	job.count = count;
+	job.separator = separator;
+	job.offsets = offsets;
+	if(!job.offsets)
+	{
+		job.offsets = (size_t *) uri_mem_alloc_((count + 1) * sizeof(size_t));
+		if(!job.offsets)
+		{
+			return NULL;
+		}
+	}
+	job.offsets[0] = 0;
+	if(!uri_strbatch_prepare_(uris, count))
+	{
+		uri_strbatch_run_(&job, nthreads, uri_strbatch_measure_);
+		for(c = 0; c < count; c++)
+		{
+			job.offsets[c + 1] += job.offsets[c];
+		}
+		job.buf = (char *) malloc(job.offsets[count] + 1);
+	}
+	if(job.buf)
+	{
+		uri_strbatch_run_(&job, nthreads, uri_strbatch_write_);
+		job.buf[job.offsets[count]] = 0;
+		if(len)
+		{
+			*len = job.offsets[count];
+		}
+	}
+	if(job.offsets != offsets)
+	{
+		uri_mem_free_(job.offsets);
+	}
+	return job.buf;
+}
+
+/* Internal: materialise any lazily-parsed components of each URI, and
+ * carry out any deferred normalisation, on the calling thread, so that
+ * the workers need only read the URIs
+ */
+static int
+uri_strbatch_prepare_(const URI *const *uris, size_t count)
+{
+	size_t c;
+
+	for(c = 0; c < count; c++)
+	{
+		if(!uris[c])
+		{
+			continue;
+		}
+		uri_lazy_(uris[c], URI_LAZY_ALL_);
+		if(uris[c]->normalise == URI_PARSE_NORMALISE_LAZY && uri_normalise((URI *) uris[c]))
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Internal: apply fn to the whole of a job, dividing it between up to
+ * nthreads threads; a range whose thread can't be started (or the whole
+ * job, if the threads can't be set up) is handled by the calling thread
+ * instead
+ */
+static void
+uri_strbatch_run_(struct uri_strbatch_struct *job, unsigned nthreads, void *(*fn)(void *))
+{
+	struct uri_strbatch_worker_struct single, *workers;
+	pthread_t *threads;
+	size_t c, nworkers, per;
+	int *started;
+
+	nworkers = job->count / URI_STRBATCH_MINCHUNK_;
+	if(nworkers > nthreads)
+	{
+		nworkers = nthreads;
+	}
+	workers = NULL;
+	threads = NULL;
+	started = NULL;
+	if(nworkers > 1)
+	{
+		workers = (struct uri_strbatch_worker_struct *) uri_mem_calloc_(nworkers, sizeof(struct uri_strbatch_worker_struct));
+		threads = (pthread_t *) uri_mem_calloc_(nworkers, sizeof(pthread_t));
+		started = (int *) uri_mem_calloc_(nworkers, sizeof(int));
+	}
+	if(!workers || !threads || !started)
+	{
+		/* The whole job is handled by the calling thread */
+		uri_mem_free_(workers);
+		uri_mem_free_(threads);
+		uri_mem_free_(started);
+		single.job = job;
+		single.first = 0;
+		single.last = job->count;
+		fn(&single);
+		return;
+	}
+	per = job->count / nworkers;
+	for(c = 0; c < nworkers; c++)
+	{
+		workers[c].job = job;
+		workers[c].first = c * per;
+		workers[c].last = (c + 1 == nworkers ? job->count : (c + 1) * per);
+	}
+	for(c = 1; c < nworkers; c++)
+	{
+		started[c] = !pthread_create(&(threads[c]), NULL, fn, &(workers[c]));
+	}
+	fn(&(workers[0]));
+	for(c = 1; c < nworkers; c++)
+	{
+		if(started[c])
+		{
+			pthread_join(threads[c], NULL);
+		}
+		else
+		{
+			fn(&(workers[c]));
+		}
+	}
+	uri_mem_free_(workers);
+	uri_mem_free_(threads);
+	uri_mem_free_(started);
+}
+
+/* Internal: determine the length of each entry in a worker's range */
+static void *
+uri_strbatch_measure_(void *arg)
+{
+	struct uri_strbatch_worker_struct *worker;
+	struct uri_strbatch_struct *job;
+	UriUriA authority;
+	const URI *uri;
+	size_t c;
+
+	worker = (struct uri_strbatch_worker_struct *) arg;
+	job = worker->job;
+	for(c = worker->first; c < worker->last; c++)
+	{
+		uri = job->uris[c];
+		job->offsets[c + 1] = 1;
+		if(!uri)
+		{
+			continue;
+		}
+		if(__atomic_load_n(&(uri->composedvalid), __ATOMIC_ACQUIRE) == URI_COMPOSED_COUNT_)
+		{
+			job->offsets[c + 1] += uri->composedoff[URI_COMPOSED_COUNT_];
+		}
+		else
+		{
+			job->offsets[c + 1] += uri_composed_len_(uri, &authority);
+		}
+	}
+	return NULL;
+}
+
+/* Internal: write each entry in a worker's range at its offset */
+static void *
+uri_strbatch_write_(void *arg)
+{
+	struct uri_strbatch_worker_struct *worker;
+	struct uri_strbatch_struct *job;
+	UriUriA authority;
+	const URI *uri;
+	char *p;
+	size_t c;
+
+	worker = (struct uri_strbatch_worker_struct *) arg;
+	job = worker->job;
+	for(c = worker->first; c < worker->last; c++)
+	{
+		uri = job->uris[c];
+		p = job->buf + job->offsets[c];
+		if(uri)
+		{
+			/* The cached form is used only if it is the one which was
+			 * measured
+			 */
+			if(__atomic_load_n(&(uri->composedvalid), __ATOMIC_ACQUIRE) == URI_COMPOSED_COUNT_ &&
+				uri->composedoff[URI_COMPOSED_COUNT_] + 1 == job->offsets[c + 1] - job->offsets[c])
+			{
+				memcpy(p, uri->composed, uri->composedoff[URI_COMPOSED_COUNT_]);
+			}
+			else
+			{
+				uri_composed_len_(uri, &authority);
+				uri_composed_write_(uri, &authority, p);
+			}
+		}
+		job->buf[job->offsets[c + 1] - 1] = (char) job->separator;
+	}
+	return NULL;
+}
@@ -0,0 +1,113 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Parse a large batch of URIs across several threads and check that the
+ * results are in input order
+ */
+
+#define NURIS                           2000
+#define NTHREADS                        4
+
+static int
+testbatch(const char *what, URI_BATCH *batch, size_t count)
+{
+	URI *uri;
+	char buf[64], expected[64];
+	size_t c;
+	int failed;
+
+	if(!batch)
+	{
+		fprintf(stderr, "%s: %s: failed to create batch: %s\n", __FILE__, what, strerror(errno));
+		return 1;
+	}
+	failed = 0;
+	if(uri_batch_count(batch) != count)
+	{
+		fprintf(stderr, "%s: %s: expected %lu URIs, but count was %lu\n", __FILE__, what, (unsigned long) count, (unsigned long) uri_batch_count(batch));
+		failed++;
+	}
+	for(c = 0; c < count && !failed; c++)
+	{
+		snprintf(expected, sizeof(expected), "http://www.example.com/item/%lu", (unsigned long) c);
+		uri = uri_batch_uri(batch, c);
+		if(!uri || uri_str(uri, buf, sizeof(buf)) == (size_t) -1 || strcmp(buf, expected))
+		{
+			fprintf(stderr, "%s: %s: entry %lu: expected <%s>, but result was <%s>\n", __FILE__, what, (unsigned long) c, expected, uri ? buf : "(NULL)");
+			failed++;
+		}
+	}
+	uri_batch_destroy(batch);
+	return failed;
+}
+
+int
+main(void)
+{
+	static char strbuf[NURIS][32];
+	const unsigned char *strs[NURIS];
+	char *lines, *p;
+	URI *base, *lazybase;
+	size_t c;
+	int failed;
+
+	base = uri_create_str("http://www.example.com/item/", NULL);
+	if(!base)
+	{
+		fprintf(stderr, "%s: failed to parse base URI: %s\n", __FILE__, strerror(errno));
+		return HARDERR;
+	}
+	/* A lazily-parsed base which hasn't been accessed yet is shared by
+	 * every worker
+	 */
+	lazybase = uri_create_ascii_ex("http://www.example.com/item/", 28, NULL, URI_PARSE_LAZY);
+	if(!lazybase)
+	{
+		fprintf(stderr, "%s: failed to parse lazy base URI: %s\n", __FILE__, strerror(errno));
+		return HARDERR;
+	}
+	lines = (char *) malloc(NURIS * 32);
+	if(!lines)
+	{
+		return HARDERR;
+	}
+	p = lines;
+	for(c = 0; c < NURIS; c++)
+	{
+		snprintf(strbuf[c], sizeof(strbuf[c]), "%lu", (unsigned long) c);
+		strs[c] = (const unsigned char *) strbuf[c];
+		/* Mix LF and CRLF line endings */
+		p += sprintf(p, "%lu%s", (unsigned long) c, (c & 1) ? "\r\n" : "\n");
+	}
+	failed = 0;
+	failed += testbatch("array", uri_batch_create_parallel(strs, NURIS, base, NTHREADS), NURIS);
+	failed += testbatch("lines", uri_batch_create_lines((const unsigned char *) lines, p - lines, base, NTHREADS), NURIS);
+	/* More threads than entries */
+	failed += testbatch("small", uri_batch_create_parallel(strs, 3, base, NTHREADS), 3);
+	failed += testbatch("empty", uri_batch_create_parallel(strs, 0, base, 0), 0);
+	failed += testbatch("lazy base", uri_batch_create_parallel(strs, NURIS, lazybase, NTHREADS), NURIS);
+	free(lines);
+	uri_destroy(lazybase);
+	uri_destroy(base);
+	return failed ? FAIL : PASS;
+}
@@ -0,0 +1,117 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Check that the recomposed form of a URI, which is cached between calls
+ * to uri_str(), follows each change made to the URI's components
+ */
+
+static int
+check(const char *what, const URI *uri, const char *expected)
+{
+	char buf[256], *str;
+	size_t needed;
+	int failed;
+
+	failed = 0;
+	needed = uri_str(uri, NULL, 0);
+	if(needed != strlen(expected) + 1)
+	{
+		fprintf(stderr, "%s: %s: expected a length of %lu, but it was %lu\n", __FILE__, what, (unsigned long) strlen(expected) + 1, (unsigned long) needed);
+		failed = 1;
+	}
+	if(uri_str(uri, buf, sizeof(buf)) == (size_t) -1 || strcmp(buf, expected))
+	{
+		fprintf(stderr, "%s: %s: expected <%s>, but result was <%s>\n", __FILE__, what, expected, buf);
+		failed = 1;
+	}
+	/* A buffer which is too small is rejected */
+	if(uri_str(uri, buf, strlen(expected)) != (size_t) -1)
+	{
+		fprintf(stderr, "%s: %s: expected a short buffer to be rejected\n", __FILE__, what);
+		failed = 1;
+	}
+	str = uri_stralloc(uri);
+	if(!str || strcmp(str, expected))
+	{
+		fprintf(stderr, "%s: %s: expected <%s> from uri_stralloc(), but result was <%s>\n", __FILE__, what, expected, str);
+		failed = 1;
+	}
+	free(str);
+	return failed;
+}
+
+int
+main(void)
+{
+	URI *uri, *other;
+	int failed;
+
+	failed = 0;
+	uri = uri_create_ascii("http://user@www.example.com:8080/a/b?x=1#frag", NULL);
+	if(!uri)
+	{
+		fprintf(stderr, "%s: failed to parse URI: %s\n", __FILE__, strerror(errno));
+		return HARDERR;
+	}
+	failed += check("parsed", uri, "http://user@www.example.com:8080/a/b?x=1#frag");
+	/* A copy recomposes to the same string, and compares equal */
+	other = uri_create_uri(uri, NULL);
+	failed += check("copy", other, "http://user@www.example.com:8080/a/b?x=1#frag");
+	if(!uri_equal(uri, other))
+	{
+		fprintf(stderr, "%s: expected copy to compare equal\n", __FILE__);
+		failed++;
+	}
+	/* A failure to modify the URI counts as a failure of the test */
+	failed += (uri_set_fragment(uri, "other") || check("fragment", uri, "http://user@www.example.com:8080/a/b?x=1#other"));
+	failed += (uri_set_query(uri, "y=2") || check("query", uri, "http://user@www.example.com:8080/a/b?y=2#other"));
+	failed += (uri_set_fragment(uri, NULL) || check("no fragment", uri, "http://user@www.example.com:8080/a/b?y=2"));
+	failed += (uri_set_port(uri, 0) || check("no port", uri, "http://user@www.example.com/a/b?y=2"));
+	failed += (uri_set_host(uri, "a-considerably-longer-host.example.com") || check("host", uri, "http://user@a-considerably-longer-host.example.com/a/b?y=2"));
+	failed += (uri_set_auth(uri, NULL) || check("no auth", uri, "http://a-considerably-longer-host.example.com/a/b?y=2"));
+	failed += (uri_set_scheme(uri, "https") || check("scheme", uri, "https://a-considerably-longer-host.example.com/a/b?y=2"));
+	failed += (uri_set_query(uri, NULL) || check("no query", uri, "https://a-considerably-longer-host.example.com/a/b"));
+	/* Modifying the original leaves the copy's recomposed form intact, and
+	 * the two no longer compare equal
+	 */
+	failed += check("copy after modification", other, "http://user@www.example.com:8080/a/b?x=1#frag");
+	if(uri_equal(uri, other))
+	{
+		fprintf(stderr, "%s: expected modified URI not to compare equal to its copy\n", __FILE__);
+		failed++;
+	}
+	uri_destroy(other);
+	uri_destroy(uri);
+	/* Hosts held in parsed form, non-hierarchical URIs and references */
+	uri = uri_create_ascii("http://192.168.0.1:80/x?q", NULL);
+	failed += check("IPv4", uri, "http://192.168.0.1:80/x?q");
+	uri_destroy(uri);
+	uri = uri_create_ascii("urn:example:thing?q#f", NULL);
+	failed += check("non-hierarchical", uri, "urn:example:thing?q#f");
+	failed += (uri_set_fragment(uri, "g") || check("non-hierarchical fragment", uri, "urn:example:thing?q#g"));
+	uri_destroy(uri);
+	uri = uri_create_ascii("../a//b/?q", NULL);
+	failed += check("relative", uri, "../a//b/?q");
+	uri_destroy(uri);
+	return failed ? FAIL : PASS;
+}
@@ -0,0 +1,284 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Parse data: URIs and decode their payloads */
+
+struct datatest
+{
+	const char *src;
+	const char *mediatype;
+	const char *charset;
+	const char *payload;
+};
+
+static struct datatest tests[] = {
+	{ "data:,Hello%2C%20World%21", NULL, NULL, "Hello, World!" },
+	{ "data:text/plain;base64,SGVsbG8sIFdvcmxkIQ==", "text/plain", NULL, "Hello, World!" },
+	{ "data:text/html;charset=utf-8;foo=bar;base64,PGI+aGk8L2I+", "text/html", "utf-8", "<b>hi</b>" },
+	{ "DATA:;Charset=US-ASCII,a?b#fragment", NULL, "US-ASCII", "a?b" },
+	{ "data:;base64,SGVs%62G8", NULL, NULL, "Hello" },
+	{ "data:;base64,QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVphYmNkZWZnaGlqa2xtbm9wcXJzdHV2d3h5ejAxMjM0NTY3ODkrLw==", NULL, NULL,
+	  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static const char *invalid[] = {
+	"http://www.example.com/",
+	"data:text/plain",
+	"data:,%4",
+	NULL
+};
+
+static const char *undecodable[] = {
+	"data:;base64,SG.s",
+	"data:;base64,AAAAAAAAAAAAAAA.AAAAAAAAAAAAAAAAAAAA",
+	"data:;base64,AAAAA",
+	"data:;base64,AA==AA",
+	NULL
+};
+
+static const char b64_[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int check_(const char *src, const URI_DATA *data, const struct datatest *test);
+static int check_large_(void);
+static int append_(void *ctx, const void *buf, size_t len);
+
+struct sink
+{
+	unsigned char *buf;
+	size_t len;
+};
+
+int
+main(void)
+{
+	URI_DATA data;
+	URI_DATA_READER reader;
+	URI *uri;
+	unsigned char buf[64];
+	size_t c;
+	int failed;
+
+	failed = 0;
+	for(c = 0; tests[c].src; c++)
+	{
+		if(uri_data_parse(&data, tests[c].src, strlen(tests[c].src)))
+		{
+			fprintf(stderr, "%s: <%s>: failed to parse: %s\n", __FILE__, tests[c].src, strerror(errno));
+			failed++;
+			continue;
+		}
+		failed += check_(tests[c].src, &data, &(tests[c]));
+		/* The same, via a URI object */
+		uri = uri_create_ascii(tests[c].src, NULL);
+		if(!uri || uri_data(uri, &data))
+		{
+			fprintf(stderr, "%s: <%s>: failed to obtain data from URI: %s\n", __FILE__, tests[c].src, strerror(errno));
+			uri_destroy(uri);
+			failed++;
+			continue;
+		}
+		failed += check_(tests[c].src, &data, &(tests[c]));
+		uri_destroy(uri);
+	}
+	for(c = 0; invalid[c]; c++)
+	{
+		if(!uri_data_parse(&data, invalid[c], strlen(invalid[c])) || errno != EINVAL)
+		{
+			fprintf(stderr, "%s: <%s>: invalid data: URI was parsed successfully\n", __FILE__, invalid[c]);
+			failed++;
+		}
+	}
+	for(c = 0; undecodable[c]; c++)
+	{
+		if(uri_data_parse(&data, undecodable[c], strlen(undecodable[c])))
+		{
+			fprintf(stderr, "%s: <%s>: failed to parse: %s\n", __FILE__, undecodable[c], strerror(errno));
+			failed++;
+			continue;
+		}
+		/* Once an error has occurred, it persists */
+		uri_data_open(&reader, &data);
+		while(uri_data_read(&reader, buf, sizeof(buf)) > 0);
+		if(uri_data_read(&reader, buf, sizeof(buf)) != -1 || errno != EINVAL)
+		{
+			fprintf(stderr, "%s: <%s>: malformed payload was decoded successfully\n", __FILE__, undecodable[c]);
+			failed++;
+		}
+	}
+	failed += check_large_();
+	return failed ? FAIL : PASS;
+}
+
+static int
+check_(const char *src, const URI_DATA *data, const struct datatest *test)
+{
+	URI_DATA_READER reader;
+	unsigned char buf[256];
+	const char *p;
+	size_t len, total;
+	ssize_t r;
+	int failed;
+
+	failed = 0;
+	if(!test->mediatype != !data->mediatype.first ||
+	   (test->mediatype && (strlen(test->mediatype) != data->mediatype.len || strncmp(test->mediatype, data->mediatype.first, data->mediatype.len))))
+	{
+		fprintf(stderr, "%s: <%s>: media type does not match\n", __FILE__, src);
+		failed++;
+	}
+	p = uri_data_param(data, "charset", &len);
+	if(!test->charset != !p || (p && (strlen(test->charset) != len || strncmp(test->charset, p, len))))
+	{
+		fprintf(stderr, "%s: <%s>: charset parameter does not match\n", __FILE__, src);
+		failed++;
+	}
+	/* Decode a single octet at a time */
+	uri_data_open(&reader, data);
+	total = 0;
+	while(total < sizeof(buf) && (r = uri_data_read(&reader, buf + total, 1)) > 0)
+	{
+		total += r;
+	}
+	if(total != strlen(test->payload) || memcmp(buf, test->payload, total))
+	{
+		fprintf(stderr, "%s: <%s>: expected payload <%s>, but result was <%.*s>\n", __FILE__, src, test->payload, (int) total, buf);
+		failed++;
+	}
+	return failed;
+}
+
+/* Encode a large buffer as a base64 data: URI and decode it in various
+ * ways
+ */
+static int
+check_large_(void)
+{
+	static const size_t sizes[] = { 1, 5, 12, 16, 4093, 65536 };
+	const size_t len = 1048576 + 1;
+	unsigned char *src;
+	char *str, *p;
+	size_t c, n, total;
+	unsigned long v;
+	URI_DATA data;
+	URI_DATA_READER reader;
+	URI *uri;
+	struct sink sink;
+	unsigned char *buf;
+	ssize_t r;
+	FILE *f;
+	int failed;
+
+	failed = 0;
+	src = (unsigned char *) malloc(len);
+	str = (char *) malloc(len * 2 + 64);
+	buf = (unsigned char *) malloc(len);
+	sink.buf = (unsigned char *) malloc(len);
+	sink.len = 0;
+	if(!src || !str || !buf || !sink.buf)
+	{
+		return 1;
+	}
+	for(c = 0, v = 1; c < len; c++)
+	{
+		v = v * 1103515245 + 12345;
+		src[c] = (unsigned char) (v >> 16);
+	}
+	p = str + sprintf(str, "data:application/octet-stream;base64,");
+	for(c = 0; c + 2 < len; c += 3)
+	{
+		v = ((unsigned long) src[c] << 16) | (src[c + 1] << 8) | src[c + 2];
+		*p++ = b64_[(v >> 18) & 63];
+		*p++ = b64_[(v >> 12) & 63];
+		*p++ = b64_[(v >> 6) & 63];
+		*p++ = b64_[v & 63];
+	}
+	/* len % 3 == 2 */
+	v = ((unsigned long) src[c] << 16) | (src[c + 1] << 8);
+	*p++ = b64_[(v >> 18) & 63];
+	*p++ = b64_[(v >> 12) & 63];
+	*p++ = b64_[(v >> 6) & 63];
+	*p++ = '=';
+	*p = 0;
+	if(uri_data_parse(&data, str, p - str))
+	{
+		fprintf(stderr, "%s: failed to parse large data: URI: %s\n", __FILE__, strerror(errno));
+		return 1;
+	}
+	for(n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++)
+	{
+		uri_data_open(&reader, &data);
+		total = 0;
+		while((r = uri_data_read(&reader, buf + total, (len - total < sizes[n] ? len - total : sizes[n]))) > 0)
+		{
+			total += r;
+		}
+		if(r < 0 || total != len || memcmp(buf, src, len))
+		{
+			fprintf(stderr, "%s: large payload decoded in chunks of %lu does not match\n", __FILE__, (unsigned long) sizes[n]);
+			failed++;
+		}
+	}
+	if(uri_data_each(&data, append_, &sink) || sink.len != len || memcmp(sink.buf, src, len))
+	{
+		fprintf(stderr, "%s: large payload passed to callback does not match\n", __FILE__);
+		failed++;
+	}
+	f = tmpfile();
+	if(!f)
+	{
+		return 1;
+	}
+	if(uri_data_write(&data, fileno(f)) || fseek(f, 0, SEEK_SET) ||
+	   fread(buf, 1, len, f) != len || fgetc(f) != EOF || memcmp(buf, src, len))
+	{
+		fprintf(stderr, "%s: large payload written to file does not match\n", __FILE__);
+		failed++;
+	}
+	fclose(f);
+	/* The same, via a URI object */
+	uri = uri_create_ascii(str, NULL);
+	sink.len = 0;
+	if(!uri || uri_data(uri, &data) || uri_data_each(&data, append_, &sink) || sink.len != len || memcmp(sink.buf, src, len))
+	{
+		fprintf(stderr, "%s: large payload obtained from URI does not match\n", __FILE__);
+		failed++;
+	}
+	uri_destroy(uri);
+	free(src);
+	free(str);
+	free(buf);
+	free(sink.buf);
+	return failed;
+}
+
+static int
+append_(void *ctx, const void *buf, size_t len)
+{
+	struct sink *sink;
+
+	sink = (struct sink *) ctx;
+	memcpy(sink->buf + sink->len, buf, len);
+	sink->len += len;
+	return 0;
+}
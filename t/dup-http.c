@@ -0,0 +1,157 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+#include <pthread.h>
+
+/* Check that duplicated URIs behave as independent copies, even though
+ * they share storage with the URI they were duplicated from
+ */
+
+#define NTHREADS                       4
+#define NDUPS                          1000
+
+static const char *base = "http://www.example.com:8080/a/b/c?q=1#frag";
+
+/* Duplicate a shared URI repeatedly, modifying and destroying each copy */
+static void *
+dupthread(void *arg)
+{
+	const URI *src = (const URI *) arg;
+	URI *dup;
+	long failed;
+	int c;
+
+	failed = 0;
+	for(c = 0; c < NDUPS; c++)
+	{
+		dup = uri_create_uri(src, NULL);
+		failed += test_uri(__FILE__, "thread", dup, base);
+		if(dup && (c % 2) && uri_set_host(dup, "thread.example.com"))
+		{
+			failed++;
+		}
+		uri_destroy(dup);
+	}
+	return (void *) failed;
+}
+
+int
+main(void)
+{
+	URI_ALLOCATOR allocator;
+	struct test_counts counts;
+	URI *uri, *dup, *dup2, *rel;
+	pthread_t threads[NTHREADS];
+	void *r;
+	long allocs;
+	int c, failed;
+
+	failed = 0;
+	test_allocator(&allocator, &counts);
+	if(uri_set_allocator(&allocator))
+	{
+		return HARDERR;
+	}
+	uri = uri_create_ascii(base, NULL);
+	if(!uri)
+	{
+		return HARDERR;
+	}
+	/* A duplicate requires only a single allocation, for the new object */
+	allocs = counts.allocs;
+	dup = uri_create_uri(uri, NULL);
+	if(counts.allocs - allocs != 1)
+	{
+		fprintf(stderr, "%s: duplicating made %ld allocations\n", __FILE__, counts.allocs - allocs);
+		failed++;
+	}
+	failed += test_uri(__FILE__, "dup", dup, base);
+	/* Modifying either copy mustn't affect the other */
+	if(!dup || uri_set_fragment(dup, "top") || uri_set_query(dup, "r=2") || uri_set_port(uri, 0))
+	{
+		failed++;
+	}
+	failed += test_uri(__FILE__, "modified", dup, "http://www.example.com:8080/a/b/c?r=2#top");
+	failed += test_uri(__FILE__, "modified", uri, "http://www.example.com/a/b/c?q=1#frag");
+	/* A duplicate of a duplicate outlives both */
+	dup2 = uri_create_uri(dup, NULL);
+	uri_destroy(uri);
+	uri_destroy(dup);
+	failed += test_uri(__FILE__, "dup of dup", dup2, "http://www.example.com:8080/a/b/c?r=2#top");
+	/* Reusing or rebasing a URI whose storage is shared gives it storage of
+	 * its own
+	 */
+	uri = uri_create_uri(dup2, NULL);
+	if(!uri || uri_parse_into(uri, "https://example.org/", NULL))
+	{
+		failed++;
+	}
+	failed += test_uri(__FILE__, "reused", uri, "https://example.org/");
+	failed += test_uri(__FILE__, "reused", dup2, "http://www.example.com:8080/a/b/c?r=2#top");
+	rel = uri_create_ascii("../y?z", NULL);
+	dup = uri_create_uri(rel, dup2);
+	failed += test_uri(__FILE__, "rebased", dup, "http://www.example.com:8080/a/y?z");
+	failed += test_uri(__FILE__, "rebased", rel, "../y?z");
+	uri_destroy(rel);
+	uri_destroy(dup);
+	uri_destroy(dup2);
+	uri_destroy(uri);
+	/* Normalising a duplicate of a non-hierarchical URI */
+	uri = uri_create_ascii_ex("URN:ISBN:0451450523", 19, NULL, URI_PARSE_NORMALISE_NONE);
+	dup = uri_create_uri(uri, NULL);
+	if(!dup || uri_normalise(dup))
+	{
+		failed++;
+	}
+	failed += test_uri(__FILE__, "normalised", dup, "urn:ISBN:0451450523");
+	failed += test_uri(__FILE__, "normalised", uri, "URN:ISBN:0451450523");
+	uri_destroy(uri);
+	uri_destroy(dup);
+	uri_set_allocator(NULL);
+	if(counts.outstanding)
+	{
+		fprintf(stderr, "%s: %ld allocations outstanding\n", __FILE__, counts.outstanding);
+		failed++;
+	}
+	/* Duplicate the same URI from several threads at once */
+	uri = uri_create_ascii(base, NULL);
+	if(!uri)
+	{
+		return HARDERR;
+	}
+	for(c = 0; c < NTHREADS; c++)
+	{
+		if(pthread_create(&(threads[c]), NULL, dupthread, uri))
+		{
+			return HARDERR;
+		}
+	}
+	for(c = 0; c < NTHREADS; c++)
+	{
+		pthread_join(threads[c], &r);
+		failed += (int) (long) r;
+	}
+	failed += test_uri(__FILE__, "threads", uri, base);
+	uri_destroy(uri);
+	return failed ? FAIL : PASS;
+}
@@ -0,0 +1,105 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Check that short schemes, hosts and ports set on a URI are stored
+ * within the URI object rather than allocated individually, and that
+ * longer ones are still handled correctly
+ */
+
+int
+main(void)
+{
+	URI_ALLOCATOR allocator;
+	struct test_counts counts;
+	URI *uri, *dup, *rel;
+	long allocs;
+	int failed;
+
+	failed = 0;
+	test_allocator(&allocator, &counts);
+	if(uri_set_allocator(&allocator))
+	{
+		return HARDERR;
+	}
+	uri = uri_create_ascii("http://www.example.com/a/b", NULL);
+	if(!uri)
+	{
+		return HARDERR;
+	}
+	/* None of these should allocate any memory */
+	allocs = counts.allocs;
+	if(uri_set_scheme(uri, "https") || uri_set_host(uri, "media.example.com") || uri_set_port(uri, 8443))
+	{
+		failed++;
+	}
+	if(counts.allocs != allocs)
+	{
+		fprintf(stderr, "%s: setting short components made %ld allocations\n", __FILE__, counts.allocs - allocs);
+		failed++;
+	}
+	if(strcmp(uri_scheme_str(uri), "https") || strcmp(uri_host_str(uri), "media.example.com") ||
+		strcmp(uri_port_str(uri), "8443") || uri_portnum(uri) != 8443)
+	{
+		fprintf(stderr, "%s: accessors returned unexpected values\n", __FILE__);
+		failed++;
+	}
+	failed += test_uri(__FILE__, "short", uri, "https://media.example.com:8443/a/b");
+	if(uri_set_port(uri, 65535) || uri_set_port(uri, 1))
+	{
+		failed++;
+	}
+	failed += test_uri(__FILE__, "port", uri, "https://media.example.com:1/a/b");
+	/* Longer components are allocated, and released when replaced */
+	if(uri_set_host(uri, "a-rather-longer-hostname.example.com") || uri_set_scheme(uri, "x-an-unusually-long-scheme"))
+	{
+		failed++;
+	}
+	failed += test_uri(__FILE__, "long", uri, "x-an-unusually-long-scheme://a-rather-longer-hostname.example.com:1/a/b");
+	if(uri_set_host(uri, "example.com") || uri_set_scheme(uri, "http") || uri_set_port(uri, 0))
+	{
+		failed++;
+	}
+	failed += test_uri(__FILE__, "replaced", uri, "http://example.com/a/b");
+	/* Duplicates and rebased URIs must not refer to the original's
+	 * inline storage
+	 */
+	dup = uri_create_uri(uri, NULL);
+	rel = uri_create_ascii("c?q", uri);
+	uri_destroy(uri);
+	failed += test_uri(__FILE__, "dup", dup, "http://example.com/a/b");
+	failed += test_uri(__FILE__, "rebase", rel, "http://example.com/a/c?q");
+	if(rel && (uri_set_host(rel, "www.example.org") || uri_set_port(rel, 80)))
+	{
+		failed++;
+	}
+	failed += test_uri(__FILE__, "rebase", rel, "http://www.example.org:80/a/c?q");
+	uri_destroy(dup);
+	uri_destroy(rel);
+	uri_set_allocator(NULL);
+	if(counts.outstanding)
+	{
+		fprintf(stderr, "%s: %ld allocations outstanding\n", __FILE__, counts.outstanding);
+		failed++;
+	}
+	return failed ? FAIL : PASS;
+}
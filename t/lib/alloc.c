@@ -0,0 +1,94 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_tests.h"
+
+/* A counting allocator, used to check that allocations are routed through
+ * the hooks and that everything allocated is released again
+ */
+
+static void *test_alloc(void *data, size_t size);
+static void *test_resize(void *data, void *ptr, size_t size);
+static void test_release(void *data, void *ptr);
+
+void
+test_allocator(URI_ALLOCATOR *restrict allocator, struct test_counts *restrict counts)
+{
+	memset(counts, 0, sizeof(struct test_counts));
+	allocator->alloc = test_alloc;
+	allocator->resize = test_resize;
+	allocator->release = test_release;
+	allocator->data = counts;
+}
+
+/* Check that a URI was created and recomposes to the expected string */
+int
+test_uri(const char *restrict file, const char *what, const URI *restrict uri, const char *restrict expected)
+{
+	char buf[256];
+
+	if(!uri)
+	{
+		fprintf(stderr, "%s: %s: failed to create <%s>: %s\n", file, what, expected, strerror(errno));
+		return 1;
+	}
+	uri_str(uri, buf, sizeof(buf));
+	if(strcmp(buf, expected))
+	{
+		fprintf(stderr, "%s: %s: expected <%s>, but result was <%s>\n", file, what, expected, buf);
+		return 1;
+	}
+	return 0;
+}
+
+static void *
+test_alloc(void *data, size_t size)
+{
+	struct test_counts *counts = (struct test_counts *) data;
+	void *p;
+
+	p = malloc(size);
+	if(p)
+	{
+		counts->allocs++;
+		counts->outstanding++;
+	}
+	return p;
+}
+
+static void *
+test_resize(void *data, void *ptr, size_t size)
+{
+	if(!ptr)
+	{
+		return test_alloc(data, size);
+	}
+	return realloc(ptr, size);
+}
+
+static void
+test_release(void *data, void *ptr)
+{
+	struct test_counts *counts = (struct test_counts *) data;
+
+	counts->outstanding--;
+	free(ptr);
+}
@@ -88,8 +88,16 @@ struct urimatch_simple
 	const char *expected;
 };
 
+struct test_counts
+{
+	long allocs;
+	long outstanding;
+};
+
 extern int test_urimatch(const char *restrict file, struct urimatch *restrict matches);
 extern int test_urimatch_simple(const char *restrict file, struct urimatch_simple *restrict matches);
 extern int test_recomposed(const char *restrict file, const char *restrict src, const char *restrict expected, URI *restrict base);
+extern void test_allocator(URI_ALLOCATOR *restrict allocator, struct test_counts *restrict counts);
+extern int test_uri(const char *restrict file, const char *what, const URI *restrict uri, const char *restrict expected);
 
 #endif /*!P_TESTS_H_*/
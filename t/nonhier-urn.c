@@ -0,0 +1,160 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Parse non-hierarchical URIs and check their components, recomposition
+ * and rebasing of references against them
+ */
+
+struct nonhiertest
+{
+	const char *src;
+	const char *scheme;
+	const char *nss;
+	const char *query;
+	const char *fragment;
+	const char *recomposed;
+};
+
+static struct nonhiertest tests[] = {
+	{ "urn:isbn:0451450523", "urn", "isbn:0451450523", NULL, NULL, "urn:isbn:0451450523" },
+	{ "tag:example.com,2005:feeds/1?x=y#z", "tag", "example.com,2005:feeds/1", "x=y", "z", "tag:example.com,2005:feeds/1?x=y#z" },
+	{ "mailto:user@example.com", "mailto", "user@example.com", NULL, NULL, "mailto:user@example.com" },
+	{ "about:blank", "about", "blank", NULL, NULL, "about:blank" },
+	{ "URN:ISBN:0451450523", "urn", "ISBN:0451450523", NULL, NULL, "urn:ISBN:0451450523" },
+	{ "about:", "about", "", NULL, NULL, "about:" },
+	{ "urn:x-test:%41bc", "urn", "x-test:%41bc", NULL, NULL, "urn:x-test:%41bc" },
+	{ NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+struct rebasetest
+{
+	const char *src;
+	const char *recomposed;
+};
+
+static struct rebasetest rebase[] = {
+	{ "#frag", "urn:isbn:0451450523?q#frag" },
+	{ "?r", "urn:isbn:0451450523?r" },
+	{ "?r#frag", "urn:isbn:0451450523?r#frag" },
+	{ "", "urn:isbn:0451450523?q" },
+	/* References with a path can't be resolved against an opaque base */
+	{ "foo", "foo" },
+	{ "//example.com/", "//example.com/" },
+	{ NULL, NULL }
+};
+
+static int check_(const char *src, const char *what, const char *expected, const char *actual);
+
+int
+main(void)
+{
+	URI *uri, *dup, *base;
+	char buf[256];
+	size_t c;
+	int failed;
+
+	failed = 0;
+	for(c = 0; tests[c].src; c++)
+	{
+		uri = uri_create_ascii(tests[c].src, NULL);
+		if(!uri)
+		{
+			fprintf(stderr, "%s: <%s>: failed to parse: %s\n", __FILE__, tests[c].src, strerror(errno));
+			failed++;
+			continue;
+		}
+		dup = uri_create_uri(uri, NULL);
+		if(!dup)
+		{
+			return HARDERR;
+		}
+		failed += check_(tests[c].src, "scheme", tests[c].scheme, uri_scheme_str(uri));
+		failed += check_(tests[c].src, "nss", tests[c].nss, uri_nss_str(uri));
+		failed += check_(tests[c].src, "query", tests[c].query, uri_query_str(uri));
+		failed += check_(tests[c].src, "fragment", tests[c].fragment, uri_fragment_str(uri));
+		failed += check_(tests[c].src, "host", NULL, uri_host_str(uri));
+		failed += check_(tests[c].src, "duplicate nss", tests[c].nss, uri_nss_str(dup));
+		uri_path(uri, buf, sizeof(buf));
+		failed += check_(tests[c].src, "path", tests[c].nss, buf);
+		uri_str(uri, buf, sizeof(buf));
+		failed += check_(tests[c].src, "recomposed", tests[c].recomposed, buf);
+		if(!uri_absolute(uri) || !uri_equal(uri, dup))
+		{
+			fprintf(stderr, "%s: <%s>: URI is not absolute or not equal to its duplicate\n", __FILE__, tests[c].src);
+			failed++;
+		}
+		uri_destroy(dup);
+		uri_destroy(uri);
+	}
+	/* The NSS is validated in the same way as a path */
+	uri = uri_create_ascii("urn:a b", NULL);
+	if(uri || errno != EINVAL)
+	{
+		fprintf(stderr, "%s: <urn:a b>: invalid URI was parsed successfully\n", __FILE__);
+		uri_destroy(uri);
+		failed++;
+	}
+	base = uri_create_ascii("urn:isbn:0451450523?q#f", NULL);
+	if(!base)
+	{
+		return HARDERR;
+	}
+	for(c = 0; rebase[c].src; c++)
+	{
+		uri = uri_create_ascii(rebase[c].src, base);
+		if(!uri)
+		{
+			fprintf(stderr, "%s: <%s>: failed to parse: %s\n", __FILE__, rebase[c].src, strerror(errno));
+			failed++;
+			continue;
+		}
+		uri_str(uri, buf, sizeof(buf));
+		failed += check_(rebase[c].src, "rebased", rebase[c].recomposed, buf);
+		uri_destroy(uri);
+	}
+	/* Parsing a non-hierarchical URI into an existing object */
+	uri = uri_create_ascii("http://www.example.com/", NULL);
+	if(!uri || uri_parse_into(uri, "urn:isbn:0451450523", NULL))
+	{
+		return HARDERR;
+	}
+	failed += check_("urn:isbn:0451450523", "reused nss", "isbn:0451450523", uri_nss_str(uri));
+	uri_destroy(uri);
+	uri_destroy(base);
+	return failed ? FAIL : PASS;
+}
+
+static int
+check_(const char *src, const char *what, const char *expected, const char *actual)
+{
+	if(!expected && !actual)
+	{
+		return 0;
+	}
+	if(!expected || !actual || strcmp(expected, actual))
+	{
+		fprintf(stderr, "%s: <%s>: %s: expected <%s>, but result was <%s>\n", __FILE__, src, what, expected ? expected : "(null)", actual ? actual : "(null)");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,134 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Parse URIs with each of the URI_PARSE_NORMALISE_xxx modes, and check
+ * that the components and recomposed forms are normalised (or not) as
+ * expected
+ */
+
+struct normtest
+{
+	const char *src;
+	/* The host and recomposed URI without normalisation */
+	const char *host;
+	const char *raw;
+	/* The recomposed URI after normalisation */
+	const char *normal;
+};
+
+static struct normtest tests[] = {
+	{ "http://www.example.com/a/b", "www.example.com", "http://www.example.com/a/b", "http://www.example.com/a/b" },
+	{ "HTTP://WWW.EXAMPLE.COM/a/b", "WWW.EXAMPLE.COM", "HTTP://WWW.EXAMPLE.COM/a/b", "http://www.example.com/a/b" },
+	{ "http://Example.COM/a/./b/../c?q#f", "Example.COM", "http://Example.COM/a/./b/../c?q#f", "http://example.com/a/c?q#f" },
+	{ "HTTP://127.0.0.1/./x", "127.0.0.1", "HTTP://127.0.0.1/./x", "http://127.0.0.1/x" },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static int check_(const struct normtest *test, unsigned int flags);
+
+int
+main(void)
+{
+	size_t c;
+	int failed;
+	URI *uri;
+
+	failed = 0;
+	for(c = 0; tests[c].src; c++)
+	{
+		failed += check_(&(tests[c]), URI_PARSE_NORMALISE_EAGER);
+		failed += check_(&(tests[c]), URI_PARSE_NORMALISE_NONE);
+		failed += check_(&(tests[c]), URI_PARSE_NORMALISE_LAZY);
+		failed += check_(&(tests[c]), URI_PARSE_NORMALISE_LAZY | URI_PARSE_LAZY);
+	}
+	uri = uri_create_ascii_ex(tests[0].src, strlen(tests[0].src), NULL, URI_PARSE_NORMALISE_MASK);
+	if(uri || errno != EINVAL)
+	{
+		fprintf(stderr, "%s: invalid normalisation flags were accepted\n", __FILE__);
+		uri_destroy(uri);
+		failed++;
+	}
+	return failed ? FAIL : PASS;
+}
+
+static int
+check_(const struct normtest *test, unsigned int flags)
+{
+	URI *uri, *expected;
+	char buf[256];
+	const char *host, *str;
+	int failed, normal;
+
+	uri = uri_create_ascii_ex(test->src, strlen(test->src), NULL, flags);
+	if(!uri)
+	{
+		fprintf(stderr, "%s: <%s>: [%u] failed to parse: %s\n", __FILE__, test->src, flags, strerror(errno));
+		return 1;
+	}
+	failed = 0;
+	normal = !strcmp(test->raw, test->normal);
+	/* Accessing a component doesn't cause the URI to be normalised */
+	uri_host(uri, buf, sizeof(buf));
+	host = ((flags & URI_PARSE_NORMALISE_MASK) == URI_PARSE_NORMALISE_EAGER ? NULL : test->host);
+	if(host && strcmp(buf, host))
+	{
+		fprintf(stderr, "%s: <%s>: [%u] expected host <%s>, but result was <%s>\n", __FILE__, test->src, flags, host, buf);
+		failed++;
+	}
+	if(host && !uri_normalised(uri) != !normal)
+	{
+		fprintf(stderr, "%s: <%s>: [%u] normalised state is incorrect before recomposition\n", __FILE__, test->src, flags);
+		failed++;
+	}
+	str = ((flags & URI_PARSE_NORMALISE_MASK) == URI_PARSE_NORMALISE_NONE ? test->raw : test->normal);
+	uri_str(uri, buf, sizeof(buf));
+	if(strcmp(buf, str))
+	{
+		fprintf(stderr, "%s: <%s>: [%u] expected <%s>, but result was <%s>\n", __FILE__, test->src, flags, str, buf);
+		failed++;
+	}
+	if(!uri_normalised(uri) != !(str == test->normal || normal))
+	{
+		fprintf(stderr, "%s: <%s>: [%u] normalised state is incorrect after recomposition\n", __FILE__, test->src, flags);
+		failed++;
+	}
+	/* A URI which hasn't been normalised can be explicitly */
+	if(uri_normalise(uri))
+	{
+		fprintf(stderr, "%s: <%s>: [%u] failed to normalise: %s\n", __FILE__, test->src, flags, strerror(errno));
+		failed++;
+	}
+	else
+	{
+		uri_str(uri, buf, sizeof(buf));
+		expected = uri_create_ascii(test->src, NULL);
+		if(!expected || strcmp(buf, test->normal) || !uri_equal(uri, expected))
+		{
+			fprintf(stderr, "%s: <%s>: [%u] expected <%s> after normalisation, but result was <%s>\n", __FILE__, test->src, flags, test->normal, buf);
+			failed++;
+		}
+		uri_destroy(expected);
+	}
+	uri_destroy(uri);
+	return failed;
+}
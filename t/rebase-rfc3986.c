@@ -0,0 +1,90 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Resolve the reference resolution examples given in RFC 3986 section 5.4 */
+
+#define BASE "http://a/b/c/d;p?q"
+
+static struct urimatch_simple tests[] = {
+	/* Section 5.4.1: normal examples */
+	{ "g:h", BASE, "g:h" },
+	{ "g", BASE, "http://a/b/c/g" },
+	{ "./g", BASE, "http://a/b/c/g" },
+	{ "g/", BASE, "http://a/b/c/g/" },
+	{ "/g", BASE, "http://a/g" },
+	{ "//g", BASE, "http://g" },
+	{ "?y", BASE, "http://a/b/c/d;p?y" },
+	{ "g?y", BASE, "http://a/b/c/g?y" },
+	{ "#s", BASE, "http://a/b/c/d;p?q#s" },
+	{ "g#s", BASE, "http://a/b/c/g#s" },
+	{ "g?y#s", BASE, "http://a/b/c/g?y#s" },
+	{ ";x", BASE, "http://a/b/c/;x" },
+	{ "g;x", BASE, "http://a/b/c/g;x" },
+	{ "g;x?y#s", BASE, "http://a/b/c/g;x?y#s" },
+	{ "", BASE, "http://a/b/c/d;p?q" },
+	{ ".", BASE, "http://a/b/c/" },
+	{ "./", BASE, "http://a/b/c/" },
+	{ "..", BASE, "http://a/b/" },
+	{ "../", BASE, "http://a/b/" },
+	{ "../g", BASE, "http://a/b/g" },
+	{ "../..", BASE, "http://a/" },
+	{ "../../", BASE, "http://a/" },
+	{ "../../g", BASE, "http://a/g" },
+	/* Section 5.4.2: abnormal examples */
+	{ "../../../g", BASE, "http://a/g" },
+	{ "../../../../g", BASE, "http://a/g" },
+	{ "/./g", BASE, "http://a/g" },
+	{ "/../g", BASE, "http://a/g" },
+	{ "g.", BASE, "http://a/b/c/g." },
+	{ ".g", BASE, "http://a/b/c/.g" },
+	{ "g..", BASE, "http://a/b/c/g.." },
+	{ "..g", BASE, "http://a/b/c/..g" },
+	{ "./../g", BASE, "http://a/b/g" },
+	{ "./g/.", BASE, "http://a/b/c/g/" },
+	{ "g/./h", BASE, "http://a/b/c/g/h" },
+	{ "g/../h", BASE, "http://a/b/c/h" },
+	{ "g;x=1/./y", BASE, "http://a/b/c/g;x=1/y" },
+	{ "g;x=1/../y", BASE, "http://a/b/c/y" },
+	{ "g?y/./x", BASE, "http://a/b/c/g?y/./x" },
+	{ "g?y/../x", BASE, "http://a/b/c/g?y/../x" },
+	{ "g#s/./x", BASE, "http://a/b/c/g#s/./x" },
+	{ "g#s/../x", BASE, "http://a/b/c/g#s/../x" },
+	/* A base with an empty path */
+	{ "g", "http://a", "http://a/g" },
+	{ "?y", "http://a", "http://a?y" },
+	/* An absolute path which is empty once dot-segments are removed */
+	{ "/", BASE, "http://a/" },
+	{ "/..", BASE, "http://a/" },
+	/* A reference with more segments than can be merged without
+	 * allocating
+	 */
+	{ "1/2/3/4/5/6/7/8/9/10/11/12/13/14/15/16/../17/18/19/20/21/22/23/24/25/26/27/28/29/30/31/32/33", "http://a/b/c/d/e",
+	  "http://a/b/c/d/1/2/3/4/5/6/7/8/9/10/11/12/13/14/15/17/18/19/20/21/22/23/24/25/26/27/28/29/30/31/32/33" },
+	{ NULL, NULL, NULL }
+};
+
+int
+main(void)
+{
+	return test_urimatch_simple(__FILE__, tests);
+}
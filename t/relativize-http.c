@@ -0,0 +1,154 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Create relative references, and check that each resolves back to the
+ * URI it was created from
+ */
+
+#define BASE "http://a/b/c/d;p?q"
+
+static struct urimatch_simple tests[] = {
+	{ "http://a/b/c/g", BASE, "g" },
+	{ "http://a/b/c/g/", BASE, "g/" },
+	{ "http://a/b/c/g?y#s", BASE, "g?y#s" },
+	{ "http://a/b/g", BASE, "../g" },
+	{ "http://a/b/", BASE, "../" },
+	{ "http://a/g", BASE, "/g" },
+	{ "http://a/", BASE, "/" },
+	{ "http://a/b/c/", BASE, "./" },
+	{ "http://a/b/c/d;p", BASE, "d;p" },
+	{ "http://a/b/c/d;p?q", BASE, "" },
+	{ "http://a/b/c/d;p?q#s", BASE, "#s" },
+	{ "http://a/b/c/d;p?y", BASE, "?y" },
+	{ "http://a/b/c/a:b", BASE, "./a:b" },
+	{ "http://a/b/c//x", BASE, ".//x" },
+	{ "http://a", BASE, "//a" },
+	{ "http://g/x", BASE, "//g/x" },
+	{ "http://u@a/b/c/g", BASE, "//u@a/b/c/g" },
+	{ "http://a:81/b/c/g", BASE, "//a:81/b/c/g" },
+	{ "HTTP://A/b/c/g", BASE, "g" },
+	{ "https://a/b/c/g", BASE, "https://a/b/c/g" },
+	{ "urn:example:thing", BASE, "urn:example:thing" },
+	{ "http://a/x", "http://a", "x" },
+	{ "http://a/b", "http://a/b?q", "b" },
+	{ "http://a/x/y/z", "http://a/b/c/d/e/f", "/x/y/z" },
+	{ "http://a/b/c/d/e/x", "http://a/b/c/d/e/f", "x" },
+	{ "file:///usr/share/doc/x", "file:///usr/lib/", "../share/doc/x" },
+	{ NULL, NULL, NULL }
+};
+
+static int
+check(URI *uri, URI *base, const char *src, const char *expected, const char *result)
+{
+	URI *resolved;
+	char buf[256], rbuf[256];
+	int failed;
+
+	failed = 0;
+	if(strcmp(result, expected))
+	{
+		fprintf(stderr, "%s: <%s> against <%s>: expected <%s>, but result was <%s>\n", __FILE__, src, BASE, expected, result);
+		failed = 1;
+	}
+	resolved = uri_create_ascii(result, base);
+	if(!resolved ||
+		uri_str(uri, buf, sizeof(buf)) == (size_t) -1 ||
+		uri_str(resolved, rbuf, sizeof(rbuf)) == (size_t) -1 ||
+		strcmp(buf, rbuf))
+	{
+		fprintf(stderr, "%s: <%s> resolved to <%s> rather than <%s>\n", __FILE__, result, resolved ? rbuf : "(null)", buf);
+		failed = 1;
+	}
+	uri_destroy(resolved);
+	return failed;
+}
+
+int
+main(void)
+{
+	URI *uri, *base, *ref, *uris[2];
+	URI_RESOLVER *resolver;
+	URI_BATCH *batch;
+	char buf[256];
+	size_t c, needed;
+	int failed;
+
+	failed = 0;
+	for(c = 0; tests[c].uri; c++)
+	{
+		uri = uri_create_ascii(tests[c].uri, NULL);
+		base = uri_create_ascii(tests[c].base, NULL);
+		if(!uri || !base)
+		{
+			fprintf(stderr, "%s: failed to parse <%s> or <%s>: %s\n", __FILE__, tests[c].uri, tests[c].base, strerror(errno));
+			return HARDERR;
+		}
+		needed = uri_relativize_str(uri, base, buf, sizeof(buf));
+		if(needed == (size_t) -1 || needed != strlen(buf) + 1)
+		{
+			fprintf(stderr, "%s: <%s>: failed to relativize into buffer\n", __FILE__, tests[c].uri);
+			failed++;
+		}
+		else
+		{
+			failed += check(uri, base, tests[c].uri, tests[c].expected, buf);
+		}
+		ref = uri_relativize(uri, base);
+		if(!ref || uri_str(ref, buf, sizeof(buf)) == (size_t) -1)
+		{
+			fprintf(stderr, "%s: <%s>: failed to relativize: %s\n", __FILE__, tests[c].uri, strerror(errno));
+			failed++;
+		}
+		else
+		{
+			failed += check(uri, base, tests[c].uri, tests[c].expected, buf);
+		}
+		uri_destroy(ref);
+		uri_destroy(base);
+		uri_destroy(uri);
+	}
+	/* Relativize a batch of URIs against a resolver's base */
+	base = uri_create_ascii(BASE, NULL);
+	resolver = uri_resolver_create(base);
+	uris[0] = uri_create_ascii("http://a/b/x?y", NULL);
+	uris[1] = uri_create_ascii("mailto:someone@example.com", NULL);
+	if(!resolver || !uris[0] || !uris[1])
+	{
+		fprintf(stderr, "%s: failed to create resolver: %s\n", __FILE__, strerror(errno));
+		return HARDERR;
+	}
+	batch = uri_resolver_relativize(resolver, (const URI *const *) uris, 2);
+	if(!batch ||
+		!uri_batch_uri(batch, 0) || uri_str(uri_batch_uri(batch, 0), buf, sizeof(buf)) == (size_t) -1 || strcmp(buf, "../x?y") ||
+		!uri_batch_uri(batch, 1) || uri_str(uri_batch_uri(batch, 1), buf, sizeof(buf)) == (size_t) -1 || strcmp(buf, "mailto:someone@example.com"))
+	{
+		fprintf(stderr, "%s: batch relativization produced unexpected results\n", __FILE__);
+		failed++;
+	}
+	uri_batch_destroy(batch);
+	uri_destroy(uris[1]);
+	uri_destroy(uris[0]);
+	uri_resolver_destroy(resolver);
+	uri_destroy(base);
+	return failed ? FAIL : PASS;
+}
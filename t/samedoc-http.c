@@ -0,0 +1,92 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Resolve references consisting only of a query and/or fragment, which
+ * are handled by duplicating the base rather than by rebasing
+ */
+
+#define BASE "http://user@www.example.com:8080/a/b/c.html?x=1#top"
+
+static struct urimatch_simple tests[] = {
+	{ "#sec", BASE, "http://user@www.example.com:8080/a/b/c.html?x=1#sec" },
+	{ "#", BASE, "http://user@www.example.com:8080/a/b/c.html?x=1#" },
+	{ "?page=2", BASE, "http://user@www.example.com:8080/a/b/c.html?page=2" },
+	{ "?", BASE, "http://user@www.example.com:8080/a/b/c.html?" },
+	{ "?page=2#sec", BASE, "http://user@www.example.com:8080/a/b/c.html?page=2#sec" },
+	{ "#sec?notquery", BASE, "http://user@www.example.com:8080/a/b/c.html?x=1#sec?notquery" },
+	{ "#sec", "http://www.example.com", "http://www.example.com#sec" },
+	{ "?q", "http://www.example.com/", "http://www.example.com/?q" },
+	{ "#sec", "file:///usr/share/doc/", "file:///usr/share/doc/#sec" },
+	/* A base which isn't in normal form is normalised along with the
+	 * reference
+	 */
+	{ "#sec", "HTTP://WWW.Example.COM/a/./b", "http://www.example.com/a/b#sec" },
+	{ "#sec", "urn:example:thing?q", "urn:example:thing?q#sec" },
+	{ NULL, NULL, NULL }
+};
+
+int
+main(void)
+{
+	URI *base, *uri;
+	const char *bseg, *useg;
+	size_t blen, ulen;
+	char buf[128];
+	int r;
+
+	r = test_urimatch_simple(__FILE__, tests);
+	base = uri_create_ascii(BASE, NULL);
+	if(!base)
+	{
+		fprintf(stderr, "%s: failed to parse <%s>: %s\n", __FILE__, BASE, strerror(errno));
+		return HARDERR;
+	}
+	uri = uri_create_ascii("?y#z", base);
+	if(!uri)
+	{
+		fprintf(stderr, "%s: failed to resolve <?y#z>: %s\n", __FILE__, strerror(errno));
+		return HARDERR;
+	}
+	/* The result shares the base's storage... */
+	bseg = uri_path_segment_view(base, 0, &blen);
+	useg = uri_path_segment_view(uri, 0, &ulen);
+	if(!bseg || bseg != useg || blen != ulen)
+	{
+		fprintf(stderr, "%s: expected the result to share the storage of its base\n", __FILE__);
+		r = FAIL;
+	}
+	/* ...but remains independent of it */
+	if(uri_set_host(uri, "other.example.com") || uri_set_query(base, "x=2"))
+	{
+		fprintf(stderr, "%s: failed to modify URIs: %s\n", __FILE__, strerror(errno));
+		return HARDERR;
+	}
+	uri_destroy(base);
+	if(uri_str(uri, buf, sizeof(buf)) == (size_t) -1 || strcmp(buf, "http://user@other.example.com:8080/a/b/c.html?y#z"))
+	{
+		fprintf(stderr, "%s: expected <http://user@other.example.com:8080/a/b/c.html?y#z>, but result was <%s>\n", __FILE__, buf);
+		r = FAIL;
+	}
+	uri_destroy(uri);
+	return r;
+}
@@ -0,0 +1,112 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Check indexed access to path segments, and walking them with the
+ * uri_peek()/uri_consume()/uri_rewind() cursor
+ */
+
+struct segtest
+{
+	const char *src;
+	unsigned int flags;
+	size_t count;
+	const char *segments[6];
+};
+
+static struct segtest tests[] = {
+	{ "http://www.example.com/api/v1/users/42", 0, 4, { "api", "v1", "users", "42" } },
+	{ "http://www.example.com/api/v1/users/42", URI_PARSE_LAZY, 4, { "api", "v1", "users", "42" } },
+	{ "http://www.example.com/a/b/", 0, 3, { "a", "b", "" } },
+	{ "http://www.example.com/", 0, 1, { "" } },
+	{ "http://www.example.com", 0, 0, { NULL } },
+	{ "/x/%20y", 0, 2, { "x", "%20y" } },
+	{ "relative/path", URI_PARSE_LAZY, 2, { "relative", "path" } },
+	{ "?query", 0, 0, { NULL } },
+	{ "urn:isbn:0451450523", 0, 1, { "isbn:0451450523" } },
+	{ NULL, 0, 0, { NULL } }
+};
+
+int
+main(void)
+{
+	URI *uri;
+	char buf[64];
+	const char *seg;
+	size_t c, n;
+	int failed, pass;
+
+	failed = 0;
+	for(c = 0; tests[c].src; c++)
+	{
+		uri = uri_create_ascii_ex(tests[c].src, strlen(tests[c].src), NULL, tests[c].flags);
+		if(!uri)
+		{
+			fprintf(stderr, "%s: <%s>: failed to parse: %s\n", __FILE__, tests[c].src, strerror(errno));
+			failed++;
+			continue;
+		}
+		/* Walk the segments with the cursor before and after rewinding,
+		 * so that lazily-parsed URIs are tested before the path has
+		 * been materialised
+		 */
+		for(pass = 0; pass < 2; pass++)
+		{
+			for(n = 0; (seg = uri_peek(uri)); n++)
+			{
+				if(n >= tests[c].count || strcmp(seg, tests[c].segments[n]) || uri_consume(uri) != seg)
+				{
+					fprintf(stderr, "%s: <%s>: cursor returned unexpected segment %lu <%s>\n", __FILE__, tests[c].src, (unsigned long) n, seg);
+					failed++;
+					break;
+				}
+			}
+			if(n != tests[c].count || uri_consume(uri))
+			{
+				fprintf(stderr, "%s: <%s>: cursor returned %lu segments, expected %lu\n", __FILE__, tests[c].src, (unsigned long) n, (unsigned long) tests[c].count);
+				failed++;
+			}
+			uri_rewind(uri);
+		}
+		if(uri_path_segments_count(uri) != tests[c].count)
+		{
+			fprintf(stderr, "%s: <%s>: expected %lu segments, found %lu\n", __FILE__, tests[c].src, (unsigned long) tests[c].count, (unsigned long) uri_path_segments_count(uri));
+			failed++;
+		}
+		for(n = 0; n < tests[c].count; n++)
+		{
+			uri_path_segment(uri, n, buf, sizeof(buf));
+			if(strcmp(buf, tests[c].segments[n]) || strcmp(uri_path_segment_str(uri, n), tests[c].segments[n]))
+			{
+				fprintf(stderr, "%s: <%s>: segment %lu: expected <%s>, found <%s>\n", __FILE__, tests[c].src, (unsigned long) n, tests[c].segments[n], buf);
+				failed++;
+			}
+		}
+		if(uri_path_segment_str(uri, n) || uri_path_segment(uri, n, buf, sizeof(buf)))
+		{
+			fprintf(stderr, "%s: <%s>: segment %lu should not exist\n", __FILE__, tests[c].src, (unsigned long) n);
+			failed++;
+		}
+		uri_destroy(uri);
+	}
+	return failed ? FAIL : PASS;
+}
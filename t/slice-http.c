@@ -0,0 +1,92 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lib/p_tests.h"
+
+/* Parse URIs which are slices of a larger, unterminated buffer using each
+ * of the uri_create_xxx_n() functions
+ */
+
+#define BASE "http://www.example.com/a/b"
+
+static const char buffer[] = "<http://www.example.com/one?x=1><two#f><three%20four>";
+
+static struct
+{
+	size_t offset;
+	size_t len;
+	const char *expected;
+} slices[] = {
+	{ 1, 30, "http://www.example.com/one?x=1" },
+	{ 33, 5, "http://www.example.com/a/two#f" },
+	{ 40, 12, "http://www.example.com/a/three%20four" },
+	{ 0, 0, NULL }
+};
+
+static int
+testslice(const char *what, URI *uri, const char *expected)
+{
+	char buf[256];
+
+	if(!uri)
+	{
+		fprintf(stderr, "%s: %s: failed to parse <%s>: %s\n", __FILE__, what, expected, strerror(errno));
+		return 1;
+	}
+	uri_str(uri, buf, sizeof(buf));
+	uri_destroy(uri);
+	if(strcmp(buf, expected))
+	{
+		fprintf(stderr, "%s: %s: expected <%s>, but result was <%s>\n", __FILE__, what, expected, buf);
+		return 1;
+	}
+	return 0;
+}
+
+int
+main(void)
+{
+	wchar_t wbuf[sizeof(buffer)];
+	URI *base;
+	size_t c;
+	int failed;
+
+	setlocale(LC_ALL, "C");
+	base = uri_create_ascii(BASE, NULL);
+	if(!base)
+	{
+		return HARDERR;
+	}
+	for(c = 0; c < sizeof(buffer); c++)
+	{
+		wbuf[c] = (wchar_t) buffer[c];
+	}
+	failed = 0;
+	for(c = 0; slices[c].expected; c++)
+	{
+		failed += testslice("ascii", uri_create_ascii_n(buffer + slices[c].offset, slices[c].len, base), slices[c].expected);
+		failed += testslice("ustr", uri_create_ustr_n((const unsigned char *) buffer + slices[c].offset, slices[c].len, base), slices[c].expected);
+		failed += testslice("wstr", uri_create_wstr_n(wbuf + slices[c].offset, slices[c].len, base), slices[c].expected);
+		failed += testslice("str", uri_create_str_n(buffer + slices[c].offset, slices[c].len, base), slices[c].expected);
+	}
+	uri_destroy(base);
+	return failed ? FAIL : PASS;
+}
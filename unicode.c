@@ -36,18 +36,27 @@ static int uri_preprocess_utf8_(char *restrict buf, const unsigned char *restric
 URI *
 uri_create_wstr(const wchar_t *restrict wstr, const URI *restrict base)
 {
-	const wchar_t *t;
+	return uri_create_wstr_n(wstr, wcslen(wstr), base);
+}
+
+/* Create a URI from the first len characters of a wide-character Unicode
+ * string
+ */
+URI *
+uri_create_wstr_n(const wchar_t *restrict wstr, size_t len, const URI *restrict base)
+{
+	const wchar_t *t, *end;
 	char *buf, *bp;
-	size_t l, needed;
+	size_t needed;
 	URI *uri;
 
-	l = wcslen(wstr);
-	needed = l + 1;
-	for(t = wstr; *t; t++)
+	end = wstr + len;
+	needed = len + 1;
+	for(t = wstr; t < end; t++)
 	{
 		if(*t < 33)
 		{
-			l += 2;
+			needed += 2;
 		}
 		else if(*t > 127)
 		{
@@ -56,16 +65,16 @@ uri_create_wstr(const wchar_t *restrict wstr, const URI *restrict base)
 			 * consumes 3 bytes in the destination string, minus the
 			 * one byte we've already accounted for
 			 */
-			l += 17;
+			needed += 17;
 		}
 	}
-	buf = (char *) calloc(1, needed);
+	buf = (char *) uri_mem_alloc_(needed);
 	if(!buf)
 	{
 		return NULL;
 	}
 	bp = buf;
-	for(t = wstr; *t; t++)
+	for(t = wstr; t < end; t++)
 	{
 		if(*t < 31 || *t > 127)
 		{
@@ -77,9 +86,8 @@ uri_create_wstr(const wchar_t *restrict wstr, const URI *restrict base)
 			bp++;
 		}
 	}
-	*bp = 0;
-	uri = uri_create_ascii(buf, base);
-	free(buf);
+	uri = uri_parse_(buf, bp - buf, base, NULL);
+	uri_mem_free_(buf);
 	return uri;
 }
 
@@ -88,62 +96,111 @@ uri_create_wstr(const wchar_t *restrict wstr, const URI *restrict base)
  */
 URI *
 uri_create_ustr(const unsigned char *restrict ustr, const URI *restrict base)
+{
+	return uri_create_ustr_n(ustr, strlen((const char *) ustr), base);
+}
+
+/* Create a URI from the first len octets of a UTF-8-encoded string */
+URI *
+uri_create_ustr_n(const unsigned char *restrict ustr, size_t len, const URI *restrict base)
 {
 	const unsigned char *t;
 	char *buf;
-	size_t l, needed;
+	size_t buflen;
 	URI *uri;
 
+	/* If no characters need to be percent-encoded, the string can be
+	 * parsed in place
+	 */
+	for(t = ustr; t < ustr + len && *t > 32 && *t < 128; t++);
+	if(t == ustr + len)
+	{
+		return uri_parse_((const char *) ustr, len, base, NULL);
+	}
+	buf = NULL;
+	buflen = 0;
+	if(uri_preprocess_ustr_(ustr, len, &buf, &buflen))
+	{
+		uri_mem_free_(buf);
+		return NULL;
+	}
+	uri = uri_parse_(buf, strlen(buf), base, NULL);
+	uri_mem_free_(buf);
+	return uri;
+}
+
+/* Internal: percent-encode the non-printable and non-ASCII characters of
+ * the first l bytes of a UTF-8-encoded string into *buf, which is
+ * (re-)allocated as needed; *buflen is the current size of *buf, which
+ * allows a single buffer to be reused for a sequence of strings
+ */
+int
+uri_preprocess_ustr_(const unsigned char *restrict ustr, size_t l, char *restrict *restrict buf, size_t *restrict buflen)
+{
+	const unsigned char *t;
+	char *p;
+	size_t needed;
+
 	/* Determine the required buffer size, accounting for percent-encoding
 	 * of non-printable and non-ASCII characters
 	 */
-	l = strlen((const char *) ustr);
 	needed = l + 1;
-	for(t = ustr; *t; t++)
+	for(t = ustr; t < ustr + l && *t; t++)
 	{
 		if(*t < 33 || *t > 127)
 		{
 			needed += 2;
 		}
 	}
-	buf = (char *) calloc(1, needed);
-	if(!buf)
-	{
-		return NULL;
-	}
-	if(uri_preprocess_utf8_(buf, ustr, l))
+	if(needed > *buflen)
 	{
-		free(buf);
-		return NULL;
+		p = (char *) uri_mem_realloc_(*buf, needed);
+		if(!p)
+		{
+			errno = ENOMEM;
+			return -1;
+		}
+		*buf = p;
+		*buflen = needed;
 	}
-	uri = uri_create_ascii(buf, base);
-	free(buf);
-	return uri;
+	memset(*buf, 0, needed);
+	return uri_preprocess_utf8_(*buf, ustr, l);
 }
 
 /* Create a URI from a string in the current locale */
 URI *
 uri_create_str(const char *restrict uristr, const URI *restrict base)
+{
+	return uri_create_str_n(uristr, strlen(uristr), base);
+}
+
+/* Create a URI from the first len bytes of a string in the current locale */
+URI *
+uri_create_str_n(const char *restrict uristr, size_t len, const URI *restrict base)
 {
 	char *buf;
 	URI *uri;
-	size_t l, numwide;
+	size_t numwide;
 
 	/* XXX We should do this via mbstowcs() and then uri_create_wstr() */
-	l = strlen(uristr) + 1;
-	numwide = uri_widebytes_(uristr, l);
-	buf = (char *) malloc(l + numwide * 3);
+	numwide = uri_widebytes_(uristr, len);
+	if(numwide == (size_t) -1)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	buf = (char *) uri_mem_alloc_(len + 1 + numwide * 3);
 	if(!buf)
 	{
 		return NULL;
 	}
-	if(uri_preprocess_(buf, uristr, l))
+	if(uri_preprocess_(buf, uristr, len))
 	{
-		free(buf);
+		uri_mem_free_(buf);
 		return NULL;
 	}
-	uri = uri_create_ascii(buf, base);
-	free(buf);
+	uri = uri_parse_(buf, strlen(buf), base, NULL);
+	uri_mem_free_(buf);
 	return uri;
 }
 
@@ -235,28 +292,33 @@ static size_t
 uri_widebytes_(const char *uristr, size_t nbytes)
 {
 	wchar_t ch;
-	int r;
+	mbstate_t state;
+	size_t r;
 	const char *p;
 	size_t numwide;
 
-	mbtowc(&ch, NULL, 0);
+	/* mbrtowc() is used in preference to mbtowc() so that the shift state
+	 * is private to this call, rather than shared between threads
+	 */
+	memset(&state, 0, sizeof(state));
 	numwide = 0;
-	for(p = uristr; *p;)
+	for(p = uristr; nbytes;)
 	{
-		r = mbtowc(&ch, p, nbytes);
-		if(r <= 0)
+		r = mbrtowc(&ch, p, nbytes, &state);
+		if(r == 0 || r == (size_t) -1 || r == (size_t) -2)
 		{
 			return (size_t) -1;
-		}		
+		}
 		if(ch < 33 || ch > 127)
 		{
 			/* Account for the full 6 bytes of UTF-8: we can't assume that
-			 * the source string (and hence the return value of mbtowc()) is
+			 * the source string (and hence the return value of mbrtowc()) is
 			 * itself UTF-8, as it's locale-dependent.
 			 */
 			numwide += 6;
 		}
 		p += r;
+		nbytes -= r;
 	}
 	return numwide;
 }
@@ -269,20 +331,20 @@ static int
 uri_preprocess_(char *restrict buf, const char *restrict uristr, size_t nbytes)
 {
 	wchar_t ch;
+	mbstate_t state;
 	char *bp;
-	int r;
+	size_t r;
 
 	/* Reset the multibyte shift state */
-	mbtowc(&ch, NULL, 0);
-	r = 0;
+	memset(&state, 0, sizeof(state));
 	for(bp = buf; nbytes && *uristr;)
 	{
 		/* Convert the next character sequence into a wide character */
-		r = mbtowc(&ch, uristr, nbytes);
-		if(r <= 0)
+		r = mbrtowc(&ch, uristr, nbytes, &state);
+		if(r == 0 || r == (size_t) -1 || r == (size_t) -2)
 		{
 			return -1;
-		}		
+		}
 		if(ch < 33 || ch > 127)
 		{
 			/* If the character is outside of the ASCII printable range,
@@ -25,6 +25,10 @@
 
 #include "p_liburi.h"
 
+static URI *uri_share_(const URI *src, URI *owner);
+static int uri_share_str_(URI *p, const URI *src, char **dest, const char *str);
+static void uri_unshare_(URI *uri);
+
 /* Create a new URI from an existing URI. If base is provided, the
  * new URI will be rebased against it.
  */
@@ -49,14 +53,19 @@ uri_create_uri(const URI *restrict source, const URI *restrict base)
 	return uri;
 }
 
-/* Destroy a URI object */
+/* Destroy a URI object; a URI which belongs to a batch is only emptied,
+ * as the object itself is released along with the batch
+ */
 int
 uri_destroy(URI *uri)
 {
 	if(uri)
 	{
 		uri_reset_(uri);
-		free(uri);
+		if(!uri->arena)
+		{
+			uri_release_(uri);
+		}
 	}
 	return 0;
 }	
@@ -69,95 +78,381 @@ uri_absolute(const URI *uri)
 }
 
 
-/* Internal: allocate a new URI object */
+/* Internal: allocate a new URI object, optionally reserving storage bytes
+ * immediately following it for use as the URI's storage block. If arena
+ * is non-NULL, the object is allocated from it.
+ */
 URI *
-uri_create_(void)
+uri_create_(size_t storage, struct uri_arena_struct *arena)
 {
 	URI *p;
-	p = (URI *) calloc(1, sizeof(URI));
+
+	if(!arena)
+	{
+		/* Allocate from the current thread's context, if there is one */
+		arena = uri_context_arena_();
+	}
+	if(arena)
+	{
+		p = (URI *) uri_arena_alloc_(arena, sizeof(URI) + storage);
+	}
+	else
+	{
+		p = (URI *) uri_mem_calloc_(1, sizeof(URI) + storage);
+	}
 	if(!p)
 	{
 		return NULL;
 	}
-	
+	p->arena = arena;
+	p->refs = 1;
+	if(storage)
+	{
+		p->block = (char *) (p + 1);
+		p->blocksize = storage;
+	}
 	return p;
 }
 
-/* Internal: duplicate an existing URI object */
+/* Internal: duplicate an existing URI object. Where possible, the
+ * duplicate shares the source's storage block rather than copying it; the
+ * block is then never modified, and is only released once every URI using
+ * it has been destroyed or given a block of its own. The setters replace
+ * only the component being set, and so never touch a shared block.
+ */
 URI *
 uri_dup_(const URI *src)
 {
-	URI *p;
+	URI *p, *owner;
+	UriUriA mirror;
+	char *expected;
 	
-	p = (URI *) calloc(1, sizeof(URI));
+	/* Any lazily-parsed components must be materialised before they can
+	 * be shared or copied
+	 */
+	uri_lazy_(src, URI_LAZY_ALL_);
+	/* Storage can't be shared with, or by, a URI whose lifetime is bound
+	 * to that of an arena
+	 */
+	owner = (src->owner ? src->owner : (URI *) src);
+	if(src->block && !owner->arena && !uri_context_arena_())
+	{
+		/* An object shares at most one block, which is fixed by the first
+		 * duplicate made of it; if its own block has since been replaced,
+		 * the new one is copied instead
+		 */
+		expected = NULL;
+		if(src->owner || __atomic_compare_exchange_n(&(owner->sharedblock), &expected, src->block, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || expected == src->block)
+		{
+			return uri_share_(src, owner);
+		}
+	}
+	/* Otherwise, the components are copied into a new block in the same
+	 * way as the output of the parser
+	 */
+	uri_mirror_(src, &mirror);
+	p = uri_create_(uri_store_size_(&mirror), NULL);
 	if(!p)
 	{
 		return NULL;
 	}
-	/* Copy of each of the string properties */
+	if(uri_store_(p, &mirror))
+	{
+		uri_destroy(p);
+		return NULL;
+	}
+	/* Copy of each of the string properties which aren't held in the
+	 * storage block
+	 */
 #define URI_COPYSTR_(dest, src, member) \
 	if((src)->member) \
 	{ \
-		(dest)->member = strdup((src)->member); \
+		(dest)->member = uri_strdup_((dest), (src)->member); \
 		if(!(dest)->member) \
 		{ \
 			uri_destroy((dest)); \
 			return NULL; \
 		} \
 	}
-	URI_COPYSTR_(p, src, scheme);
-	URI_COPYSTR_(p, src, auth);
 	URI_COPYSTR_(p, src, user);
 	URI_COPYSTR_(p, src, password);
-	URI_COPYSTR_(p, src, hoststr);
-	URI_COPYSTR_(p, src, portstr);
 	URI_COPYSTR_(p, src, authority);
-	URI_COPYSTR_(p, src, nss);
-	URI_COPYSTR_(p, src, query);
-	URI_COPYSTR_(p, src, fragment);
-	URI_COPYSTR_(p, src, composed);
 #undef URI_COPYSTR_
-	/* Copy the host info */
-	uri_hostdata_copy_(&(p->hostdata), &(src->hostdata));
 	p->port = src->port;
-	/* Copy the path */
-	uri_path_copy_(p, src->pathfirst);
 	/* Copy the flags */
 	p->pathabs = src->pathabs;
-	/* Now set the UriUri members to point to the new strings */
-	uri_postparse_set_(p);
+	p->absolute = src->absolute;
+	p->hier = src->hier;
+	/* The NSS of a non-hierarchical URI is the text of its only path
+	 * segment
+	 */
+	if(!p->hier && p->pathfirst)
+	{
+		p->nss = (char *) p->pathfirst->text.first;
+	}
+	p->normalise = src->normalise;
+	p->normalised = src->normalised;
 	return p;
 }
 
+/* Internal: create a URI which shares the storage block of src, which is
+ * owned by owner
+ */
+static URI *
+uri_share_(const URI *src, URI *owner)
+{
+	URI *p;
+
+	p = uri_create_(0, NULL);
+	if(!p)
+	{
+		return NULL;
+	}
+	memcpy(p, src, sizeof(URI));
+	p->arena = NULL;
+	p->refs = 1;
+	p->sharedblock = NULL;
+	p->owner = owner;
+	__atomic_add_fetch(&(owner->refs), 1, __ATOMIC_RELAXED);
+	/* Any strings which aren't held in the shared block must be copied;
+	 * the members are emptied first so that if this fails part-way, the
+	 * new object can still be destroyed safely
+	 */
+	p->scheme = p->auth = p->user = p->password = p->hoststr = p->portstr = NULL;
+	p->authority = p->nss = p->query = p->fragment = p->composed = NULL;
+	/* The recomposed form is rebuilt by the new object when it's needed,
+	 * rather than being copied while src might be rebuilding its own
+	 */
+	p->composedsize = 0;
+	p->composedvalid = 0;
+	p->composing = 0;
+#define URI_SHARESTR_(member) \
+	if(uri_share_str_(p, src, &(p->member), src->member)) \
+	{ \
+		uri_destroy(p); \
+		return NULL; \
+	}
+	URI_SHARESTR_(scheme);
+	URI_SHARESTR_(auth);
+	URI_SHARESTR_(user);
+	URI_SHARESTR_(password);
+	URI_SHARESTR_(hoststr);
+	URI_SHARESTR_(portstr);
+	URI_SHARESTR_(authority);
+	URI_SHARESTR_(nss);
+	URI_SHARESTR_(query);
+	URI_SHARESTR_(fragment);
+#undef URI_SHARESTR_
+	return p;
+}
+
+/* Internal: set *dest to the equivalent within p of the string str held by
+ * src: a pointer into the shared block is used as-is, a pointer into one of
+ * src's inline buffers is moved to the corresponding buffer in p, and
+ * anything else is duplicated
+ */
+static int
+uri_share_str_(URI *p, const URI *src, char **dest, const char *str)
+{
+	if(!str)
+	{
+		return 0;
+	}
+	if(str >= src->block && str < src->block + src->blocksize)
+	{
+		*dest = (char *) str;
+		return 0;
+	}
+	if(str >= (const char *) src && str < (const char *) (src + 1))
+	{
+		*dest = (char *) p + (str - (const char *) src);
+		return 0;
+	}
+	*dest = uri_strdup_(p, str);
+	return (*dest ? 0 : -1);
+}
+
+/* Internal: drop a reference to a URI object, releasing it (along with the
+ * block it shares with other URIs, if any) once none remain
+ */
+void
+uri_release_(URI *uri)
+{
+	if(__atomic_sub_fetch(&(uri->refs), 1, __ATOMIC_ACQ_REL))
+	{
+		return;
+	}
+	if(uri->sharedblock && uri->sharedblock != (char *) (uri + 1))
+	{
+		uri_mem_free_(uri->sharedblock);
+	}
+	uri_mem_free_(uri);
+}
+
+/* Internal: return nonzero if the URI's storage block is shared with other
+ * URIs, and so must not be modified
+ */
+int
+uri_shared_(const URI *uri)
+{
+	return (uri->owner || (uri->block && uri->block == uri->sharedblock));
+}
+
+/* Internal: stop using a storage block which is shared with other URIs, so
+ * that a new block will be allocated when the URI is next stored into
+ */
+static void
+uri_unshare_(URI *uri)
+{
+	URI *owner;
+
+	if(!uri_shared_(uri))
+	{
+		return;
+	}
+	owner = uri->owner;
+	uri->owner = NULL;
+	uri->block = NULL;
+	uri->blocksize = 0;
+	if(owner)
+	{
+		uri_release_(owner);
+	}
+}
+
+/* Internal: free a pointer held by a URI, unless it points within the
+ * URI's storage block (in which case it will be released along with the
+ * block itself) or one of its inline buffers, or the URI was allocated
+ * from an arena (in which case everything it holds is released along with
+ * the arena)
+ */
+void
+uri_free_(URI *uri, void *ptr)
+{
+	if(!ptr || uri->arena)
+	{
+		return;
+	}
+	if(uri->block && (char *) ptr >= uri->block && (char *) ptr < uri->block + uri->blocksize)
+	{
+		return;
+	}
+	if((char *) ptr >= (char *) uri && (char *) ptr < (char *) (uri + 1))
+	{
+		return;
+	}
+	uri_mem_free_(ptr);
+}
+
+/* Internal: copy a component string of len characters into buf, truncating
+ * it if necessary, and return the buffer size needed to hold all of it, or
+ * zero if str is NULL
+ */
+size_t
+uri_copy_(const char *restrict str, size_t len, char *restrict buf, size_t buflen)
+{
+	size_t n;
+
+	if(buf && buflen)
+	{
+		n = (str ? len : 0);
+		if(n >= buflen)
+		{
+			n = buflen - 1;
+		}
+		if(n)
+		{
+			memcpy(buf, str, n);
+		}
+		buf[n] = 0;
+	}
+	return (str ? len + 1 : 0);
+}
+
 /* Internal: safely free the contents of a URI object, so that they can be
  * replaced
  */
 int
 uri_reset_(URI *uri)
+{
+	uri_clear_(uri);
+	/* Release the storage block, unless it was allocated along with the
+	 * URI object itself or from an arena
+	 */
+	if(!uri->arena && uri->block != (char *) (uri + 1))
+	{
+		uri_mem_free_(uri->block);
+	}
+	uri->block = NULL;
+	uri->blocksize = 0;
+	return 0;
+}
+
+/* Internal: free the contents of a URI object, as uri_reset_(), but retain
+ * its storage block so that it can be reused
+ */
+int
+uri_clear_(URI *uri)
 {
 	UriPathSegmentA *seg, *next;
+	struct uri_arena_struct *arena;
+	char *block, *sharedblock;
+	size_t blocksize;
+	unsigned long refs;
 
-	uriFreeUriMembersA(&(uri->uri));
-	free(uri->scheme);
-	free(uri->auth);
-	free(uri->user);
-	free(uri->password);
-	free(uri->hoststr);
-	free(uri->hostdata.ip4);
-	free(uri->hostdata.ip6);
-	free((char *) uri->hostdata.ipFuture.first);
-	free(uri->portstr);
-	free(uri->authority);
-	free(uri->nss);
+	uri_free_(uri, uri->scheme);
+	uri_free_(uri, uri->auth);
+	uri_free_(uri, uri->user);
+	uri_free_(uri, uri->password);
+	uri_free_(uri, uri->hoststr);
+	uri_free_(uri, uri->hostdata.ip4);
+	uri_free_(uri, uri->hostdata.ip6);
+	uri_free_(uri, (char *) uri->hostdata.ipFuture.first);
+	uri_free_(uri, uri->hostlit);
+	uri_free_(uri, uri->portstr);
+	uri_free_(uri, uri->authority);
+	uri_free_(uri, uri->nss);
 	for(seg = uri->pathfirst; seg; seg = next)
 	{
 		next = seg->next;
-		free((char *) seg->text.first);
-		free(seg);
+		uri_free_(uri, (char *) seg->text.first);
+		uri_free_(uri, seg);
 	}
-	free(uri->query);
-	free(uri->fragment);
-	free(uri->composed);
+	uri_free_(uri, uri->query);
+	uri_free_(uri, uri->fragment);
+	uri_free_(uri, uri->composed);
+	/* The storage block and arena are properties of the object rather than
+	 * its contents, and so are retained, unless the block is shared with
+	 * other URIs
+	 */
+	uri_unshare_(uri);
+	arena = uri->arena;
+	block = uri->block;
+	blocksize = uri->blocksize;
+	refs = uri->refs;
+	sharedblock = uri->sharedblock;
 	memset(uri, 0, sizeof(URI));
+	uri->arena = arena;
+	uri->block = block;
+	uri->blocksize = blocksize;
+	uri->refs = refs;
+	uri->sharedblock = sharedblock;
 	return 0;
 }
+
+/* Internal: replace the contents of uri, which must have been emptied by
+ * uri_reset_(), with those of the temporary object src, retaining those
+ * members which are properties of the object itself
+ */
+void
+uri_move_(URI *restrict uri, const URI *restrict src)
+{
+	unsigned long refs;
+	char *sharedblock;
+
+	refs = uri->refs;
+	sharedblock = uri->sharedblock;
+	memcpy(uri, src, sizeof(URI));
+	uri->refs = refs;
+	uri->sharedblock = sharedblock;
+}
@@ -0,0 +1,139 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright 2017 BBC
+ */
+
+/*
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_liburi.h"
+
+static void uri_view_range_(URI_RANGE *restrict dest, const UriTextRangeA *restrict src);
+static const char *uri_view_get_(const URI_RANGE *restrict range, size_t *restrict len);
+
+/* Parse a URI reference into a read-only view. No memory is allocated and
+ * the string is neither copied nor modified; it need not be null-terminated.
+ * Unlike uri_create_ascii(), no normalisation is performed and the
+ * components are exactly as they appear in str.
+ */
+int
+uri_view_parse(URI_VIEW *restrict view, const char *restrict str, size_t len)
+{
+	struct uri_scan_struct scan;
+
+	memset(view, 0, sizeof(URI_VIEW));
+	if(uri_scan_(str, len, &scan))
+	{
+		return -1;
+	}
+	uri_view_range_(&(view->scheme), &(scan.scheme));
+	uri_view_range_(&(view->auth), &(scan.userinfo));
+	uri_view_range_(&(view->host), &(scan.host));
+	uri_view_range_(&(view->port), &(scan.port));
+	uri_view_range_(&(view->path), &(scan.path));
+	uri_view_range_(&(view->query), &(scan.query));
+	uri_view_range_(&(view->fragment), &(scan.fragment));
+	return 0;
+}
+
+/* Component accessors */
+
+const char *
+uri_view_scheme(const URI_VIEW *restrict view, size_t *restrict len)
+{
+	return uri_view_get_(&(view->scheme), len);
+}
+
+const char *
+uri_view_auth(const URI_VIEW *restrict view, size_t *restrict len)
+{
+	return uri_view_get_(&(view->auth), len);
+}
+
+const char *
+uri_view_host(const URI_VIEW *restrict view, size_t *restrict len)
+{
+	return uri_view_get_(&(view->host), len);
+}
+
+const char *
+uri_view_port(const URI_VIEW *restrict view, size_t *restrict len)
+{
+	return uri_view_get_(&(view->port), len);
+}
+
+const char *
+uri_view_path(const URI_VIEW *restrict view, size_t *restrict len)
+{
+	return uri_view_get_(&(view->path), len);
+}
+
+const char *
+uri_view_query(const URI_VIEW *restrict view, size_t *restrict len)
+{
+	return uri_view_get_(&(view->query), len);
+}
+
+const char *
+uri_view_fragment(const URI_VIEW *restrict view, size_t *restrict len)
+{
+	return uri_view_get_(&(view->fragment), len);
+}
+
+/* Return 1 if a view is absolute, 0 otherwise */
+int
+uri_view_absolute(const URI_VIEW *view)
+{
+	return (view->scheme.first ? 1 : 0);
+}
+
+/* Return the port of a view as a parsed integer */
+int
+uri_view_portnum(const URI_VIEW *view)
+{
+	size_t c;
+	unsigned long port;
+
+	port = 0;
+	for(c = 0; c < view->port.len; c++)
+	{
+		port = (port * 10) + (view->port.first[c] - '0');
+		if(port > 65535)
+		{
+			return 0;
+		}
+	}
+	return (int) port;
+}
+
+static void
+uri_view_range_(URI_RANGE *restrict dest, const UriTextRangeA *restrict src)
+{
+	dest->first = src->first;
+	dest->len = (src->first ? (size_t) (src->afterLast - src->first) : 0);
+}
+
+static const char *
+uri_view_get_(const URI_RANGE *restrict range, size_t *restrict len)
+{
+	if(len)
+	{
+		*len = range->len;
+	}
+	return range->first;
+}